@@ -2,7 +2,10 @@
 #include <string>
 #include <vector>
 #include <memory>       
+#include <mutex>
+#include <utility>
 #include "Message.hpp" 
+#include "MessagePool.hpp"
 
 namespace mylog
 {
@@ -16,10 +19,11 @@ namespace mylog
             buffer_.reserve(1024);
         }
 
-        // 接收一个 LogMessage 对象的 unique_ptr，并将其移入缓冲区
+        // 接收一条池中的日志记录，并将其移入缓冲区
         // 这是生产者（AsyncLogger）向缓冲区添加日志的唯一入口。
-        void Push(std::unique_ptr<LogMessage>&& msg)
+        void Push(MessagePtr&& msg)
         {
+            bytes_ += msg->Footprint();
             buffer_.emplace_back(std::move(msg));
         }
 
@@ -35,29 +39,93 @@ namespace mylog
             return buffer_.size();
         }
 
+        // 其中日志记录占用的内存，流水线据此限制积压的日志量
+        size_t Bytes() const
+        {
+            return bytes_;
+        }
+
         // 与另一个缓冲区交换内容。
         void Swap(Buffer& other)
         {
             buffer_.swap(other.buffer_);
+            std::swap(bytes_, other.bytes_);
+        }
+
+        // 把 other 中的日志按顺序移到本缓冲区末尾，other 被清空
+        void Append(Buffer& other)
+        {
+            if (buffer_.empty()) {
+                Swap(other);
+                return;
+            }
+            for (auto& msg : other.buffer_) {
+                buffer_.emplace_back(std::move(msg));
+            }
+            bytes_ += other.bytes_;
+            other.buffer_.clear();
+            other.bytes_ = 0;
         }
 
-        // 清空缓冲区，释放所有 LogMessage 对象。
+        // 按下标修改日志的序号等字段，只在主循环组批时使用
+        LogMessage& Mutable(size_t index)
+        {
+            return *buffer_[index];
+        }
+
+        // 清空缓冲区，日志记录归还到记录池，容量保留
         // 当消费者处理完一个缓冲区后调用。
         void Reset()
         {
             buffer_.clear();
+            bytes_ = 0;
         }
 
         // 提供对内部元素的访问
         // 返回 const 引用，防止外部修改指针
-        const std::unique_ptr<LogMessage>& at(size_t index) const
+        const MessagePtr& at(size_t index) const
         {
             return buffer_.at(index);
         }
 
     private:
-        std::vector<std::unique_ptr<LogMessage>> buffer_;
+        std::vector<MessagePtr> buffer_;
+        size_t bytes_ = 0;
+
+    };
+
+    // 用完的 Buffer 清空后放回这里复用，省掉每批一次的 Buffer 和内部数组的分配
+    class BufferPool
+    {
+    public:
+        std::unique_ptr<Buffer> Acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (!free_.empty()) {
+                    std::unique_ptr<Buffer> buf = std::move(free_.back());
+                    free_.pop_back();
+                    return buf;
+                }
+            }
+            return std::make_unique<Buffer>();
+        }
+
+        void Release(std::unique_ptr<Buffer>&& buf)
+        {
+            if (!buf) return;
+            buf->Reset(); // 在锁外归还日志记录
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (free_.size() < kMaxPooled) {
+                free_.push_back(std::move(buf));
+            }
+        }
+
+    private:
+        static constexpr size_t kMaxPooled = 256;
 
+        std::mutex mtx_;
+        std::vector<std::unique_ptr<Buffer>> free_;
     };
 
 }
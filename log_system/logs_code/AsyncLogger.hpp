@@ -6,8 +6,11 @@
 #include <string>
 #include <vector>
 
+#include "BinaryLog.hpp"
 #include "Level.hpp"
 #include "Message.hpp"
+#include "Sampling.hpp"
+#include "Structured.hpp"
 #include "LogFlush.hpp"
 #include "LogPipeline.hpp" 
 #include "ThreadPoll.hpp"   
@@ -23,99 +26,184 @@ namespace mylog
     public:
         using ptr = std::shared_ptr<AsyncLogger>;
 
-        // 构造函数：只接收日志器名和落地器列表
-        AsyncLogger(const std::string& logger_name, const std::vector<LogFlush::ptr>& flushs)
+        // 构造函数：接收日志器名和落地器列表，binary 为 true 时落地的是二进制帧，需要用 mylog_decode 查看
+        // level 是最低输出等级，低于它的日志在入口处直接丢弃
+        AsyncLogger(const std::string& logger_name, const std::vector<LogFlush::ptr>& flushs, bool binary = false,
+                    LogLevel::value level = LogLevel::value::DEBUG)
             : logger_name_(logger_name),
-              pipeline_(std::make_shared<LogPipeline>(flushs)) // 创建并chiyou
+              min_level_(static_cast<int>(level)),
+              pipeline_(std::make_shared<LogPipeline>(flushs, logger_name, binary)) // 创建并chiyou
         {}
 
         virtual ~AsyncLogger() = default;
 
         std::string Name() { return logger_name_; }
 
+        // 运行时调整最低输出等级，对所有线程立即(最终)可见，不需要加锁
+        void SetLevel(LogLevel::value level) { min_level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+        LogLevel::value GetLevel() const { return static_cast<LogLevel::value>(min_level_.load(std::memory_order_relaxed)); }
+
+        // 积压超过配置的 buffer_size 时的处理方式，默认取配置文件中的 overflow_policy
+        void SetOverflowPolicy(OverflowPolicy policy) { pipeline_->SetOverflowPolicy(policy); }
+
+        // 因积压过多被丢弃的日志条数，另外每秒会有一条 WARN 日志汇报这一期间丢弃的数量
+        uint64_t DroppedCount() const { return pipeline_->DroppedCount(); }
+
+        // 各落地器写线程的积压和滞后，每个落地器一行
+        std::string SinkReport() const { return pipeline_->SinkReport(); }
+
+        // *_LIMITED 宏的限流参数：每个调用点各自一个令牌桶，每秒 per_second 条，最多连续放行 burst 条
+        // per_second 为 0 表示不限流，运行时调整立即生效
+        void SetSiteRateLimit(double per_second, double burst)
+        {
+            int64_t interval = per_second > 0 ? static_cast<int64_t>(1e9 / per_second) : 0;
+            site_tolerance_ns_.store(static_cast<int64_t>(std::max(burst - 1, 0.0) * interval), std::memory_order_relaxed);
+            site_interval_ns_.store(interval, std::memory_order_relaxed);
+        }
+
+        bool AdmitLimited(SampledSite& site) const
+        {
+            return site.Limited(site_interval_ns_.load(std::memory_order_relaxed),
+                                site_tolerance_ns_.load(std::memory_order_relaxed));
+        }
+
+        // 调用点拦下了一条日志，第一次拦下时登记到流水线，之后每秒汇报一次拦下的条数
+        void Suppressed(SampledSite& site)
+        {
+            if (site.Suppress()) pipeline_->TrackSampledSite(&site);
+        }
+
+        // 每条日志在取记录、格式化之前先检查等级，被过滤时只有这一次读和一次分支
+        bool ShouldLog(LogLevel::value level) const
+        {
+            return static_cast<int>(level) >= min_level_.load(std::memory_order_relaxed);
+        }
+
         // 将可变参数的处理逻辑放到一个私有方法中
         void Log(LogLevel::value level, const char* file, size_t line, const char* format, ...)
         {
+            if (!ShouldLog(level)) return;
             va_list va;
             va_start(va, format);
             Handle(level, file, line, format, va);
             va_end(va);
         }
 
+        // 二进制日志入口，由 LOGBIN 系列宏调用：只记录调用点id和按类型编码的参数，不做格式化
+        template <typename... Args>
+        void LogBinary(uint32_t site_id, const Args&... args)
+        {
+            if (site_id == 0) return;
+            const BinarySite* site = BinarySites::Get(site_id);
+            if (!ShouldLog(site->level)) return;
+            MessagePtr msg = MessagePool::Acquire();
+            msg->Init(site->level, "", site->line, logger_name_.c_str());
+            msg->site_id_ = site_id;
+            size_t size = BinaryArgs::EncodedSize(args...);
+            BinaryArgs::Encode(msg->PayloadBuffer(size), args...);
+            msg->SetPayloadSize(size);
+            pipeline_->Push(std::move(msg));
+        }
+
+        // 结构化日志入口：事件名和字段按类型编码进记录，格式化线程再渲染成 logfmt 或 JSON
+        template <typename... Ts>
+        void LogFields(LogLevel::value level, const char* file, size_t line, const char* event,
+                       const Field<Ts>&... fields)
+        {
+            if (!ShouldLog(level)) return;
+            MessagePtr msg = MessagePool::Acquire();
+            msg->Init(level, file, line, logger_name_.c_str());
+            msg->structured_ = true;
+            size_t size = StructuredFields::EncodedSize(event, fields...);
+            StructuredFields::Encode(msg->PayloadBuffer(size), event, fields...);
+            msg->SetPayloadSize(size);
+            pipeline_->Push(std::move(msg));
+        }
+
     private:
-        // 处理可变参数并封装为 LogMessage
+        // 处理可变参数，格式化进池中取出的记录
         void Handle(LogLevel::value level, const char* file, size_t line, const char* format, va_list va)
         {
-            // 使用 vsnprintf 避免内存泄漏
-            va_list va_copy;
-            va_copy(va_copy, va);
-            int len = vsnprintf(nullptr, 0, format, va_copy);
-            va_end(va_copy);
-
-            if (len < 0) return;
-            
-            std::string payload(len, '\0');
-            vsnprintf(&payload[0], len + 1, format, va);
-            
-            // 创建 LogMessage 对象
-            auto msg = std::make_unique<LogMessage>(level, file, line, logger_name_, std::move(payload));
-            
-            // 分配序列号
-            msg->sequence_id_ = g_sequence_id_allocator.fetch_add(1, std::memory_order_relaxed);
-            
-            // ----------- 远程备份逻辑（保持独立） -----------
-            // 检查日志级别，决定是否触发独立的备份任务
-            // if (tp && msg->level_ >= LogLevel::value::ERROR)
-            // {
-            //     try {
-            //         // 格式化日志以供发送
-            //         std::string data_for_backup = msg->format();
-            //         tp->enqueue(start_backup, data_for_backup);
-            //     } catch(const std::runtime_error&) {
-            //         // 后面再说，再看一看
-            //     }
-            // }
-            // ---------------------------------------------
-            
-            // 将主日志流的消息压入
+            MessagePtr msg = MessagePool::Acquire();
+            msg->Init(level, file, line, logger_name_.c_str());
+            if (!msg->FormatPayload(format, va)) return;
+
+            // 将主日志流的消息压入，序列号由流水线主循环出队时分配
             pipeline_->Push(std::move(msg));
         }
 
     public:
-        void Debug(const std::string &file, size_t line, const std::string format, ...) {
-            va_list va;
-            va_start(va, format);
-            Handle(LogLevel::value::DEBUG, file.c_str(), line, format.c_str(), va);
-            va_end(va);
+        // 写成模板是为了能内联到调用处：等级被过滤时不会发生函数调用，参数也不会被传递
+        // 参数全是 kv(...) 字段时走结构化日志，例如 Info("upload", kv("path", p), kv("bytes", n))
+        template <typename... Args>
+        void Debug(const char* file, size_t line, const char* format, const Args&... args)
+        {
+            if (ShouldLog(LogLevel::value::DEBUG)) Emit(LogLevel::value::DEBUG, file, line, format, args...);
         }
-        void Info(const std::string &file, size_t line, const std::string format, ...) {
-            va_list va;
-            va_start(va, format);
-            Handle(LogLevel::value::INFO, file.c_str(), line, format.c_str(), va);
-            va_end(va);
+        template <typename T, typename... Ts>
+        void Debug(const char* file, size_t line, const char* event, const Field<T>& field, const Field<Ts>&... fields)
+        {
+            if (ShouldLog(LogLevel::value::DEBUG)) LogFields(LogLevel::value::DEBUG, file, line, event, field, fields...);
         }
-        void Warn(const std::string &file, size_t line, const std::string format, ...) {
-            va_list va;
-            va_start(va, format);
-            Handle(LogLevel::value::WARN, file.c_str(), line, format.c_str(), va);
-            va_end(va);
+        template <typename... Args>
+        void Info(const char* file, size_t line, const char* format, const Args&... args)
+        {
+            if (ShouldLog(LogLevel::value::INFO)) Emit(LogLevel::value::INFO, file, line, format, args...);
         }
-        void Error(const std::string &file, size_t line, const std::string format, ...) {
-            va_list va;
-            va_start(va, format);
-            Handle(LogLevel::value::ERROR, file.c_str(), line, format.c_str(), va);
-            va_end(va);
+        template <typename T, typename... Ts>
+        void Info(const char* file, size_t line, const char* event, const Field<T>& field, const Field<Ts>&... fields)
+        {
+            if (ShouldLog(LogLevel::value::INFO)) LogFields(LogLevel::value::INFO, file, line, event, field, fields...);
+        }
+        template <typename... Args>
+        void Warn(const char* file, size_t line, const char* format, const Args&... args)
+        {
+            if (ShouldLog(LogLevel::value::WARN)) Emit(LogLevel::value::WARN, file, line, format, args...);
+        }
+        template <typename T, typename... Ts>
+        void Warn(const char* file, size_t line, const char* event, const Field<T>& field, const Field<Ts>&... fields)
+        {
+            if (ShouldLog(LogLevel::value::WARN)) LogFields(LogLevel::value::WARN, file, line, event, field, fields...);
+        }
+        template <typename... Args>
+        void Error(const char* file, size_t line, const char* format, const Args&... args)
+        {
+            if (ShouldLog(LogLevel::value::ERROR)) Emit(LogLevel::value::ERROR, file, line, format, args...);
+        }
+        template <typename T, typename... Ts>
+        void Error(const char* file, size_t line, const char* event, const Field<T>& field, const Field<Ts>&... fields)
+        {
+            if (ShouldLog(LogLevel::value::ERROR)) LogFields(LogLevel::value::ERROR, file, line, event, field, fields...);
+        }
+        template <typename... Args>
+        void Fatal(const char* file, size_t line, const char* format, const Args&... args)
+        {
+            if (ShouldLog(LogLevel::value::FATAL)) Emit(LogLevel::value::FATAL, file, line, format, args...);
         }
-        void Fatal(const std::string &file, size_t line, const std::string format, ...) {
+        template <typename T, typename... Ts>
+        void Fatal(const char* file, size_t line, const char* event, const Field<T>& field, const Field<Ts>&... fields)
+        {
+            if (ShouldLog(LogLevel::value::FATAL)) LogFields(LogLevel::value::FATAL, file, line, event, field, fields...);
+        }
+
+        // 编译期等级(MYLOG_MIN_LEVEL)以下的 Debug/Info 等宏展开成这个空调用，参数不会被求值
+        void Disabled() const {}
+
+    private:
+        // 等级检查通过后才走到这里，不再重复检查
+        void Emit(LogLevel::value level, const char* file, size_t line, const char* format, ...)
+        {
             va_list va;
             va_start(va, format);
-            Handle(LogLevel::value::FATAL, file.c_str(), line, format.c_str(), va);
+            Handle(level, file, line, format, va);
             va_end(va);
         }
 
-
     private:
         std::string logger_name_;
+        std::atomic<int> min_level_;
+        std::atomic<int64_t> site_interval_ns_{0};  // 调用点限流的放行间隔，0 表示不限
+        std::atomic<int64_t> site_tolerance_ns_{0}; // 允许提前放行的时间，决定突发量
         std::shared_ptr<LogPipeline> pipeline_;
     };
 
@@ -131,6 +219,9 @@ namespace mylog
         {
             flushs_.emplace_back(LogFlushFactory::CreateLog<FlushType>(std::forward<Args>(args)...));
         }
+
+        // 使用调用方自己创建的落地器，便于之后读取它的统计信息
+        void BuildLoggerFlush(const LogFlush::ptr& flush) { flushs_.emplace_back(flush); }
         
         AsyncLogger::ptr Build()
         {
@@ -140,10 +231,58 @@ namespace mylog
             if (flushs_.empty()) {
                 flushs_.emplace_back(std::make_shared<StdoutFlush>());
             }
-            return std::make_shared<AsyncLogger>(logger_name_, flushs_);
+            LogLevel::value level = LogLevel::value::DEBUG;
+            if (has_level_) {
+                level = level_;
+            } else if (g_conf_data != nullptr) {
+                level = LogLevel::FromString(g_conf_data->log_level, LogLevel::value::DEBUG);
+            }
+            auto logger = std::make_shared<AsyncLogger>(logger_name_, flushs_, binary_, level);
+            if (has_overflow_policy_) {
+                logger->SetOverflowPolicy(overflow_policy_);
+            }
+            if (has_site_rate_limit_) {
+                logger->SetSiteRateLimit(site_rate_limit_, site_rate_burst_);
+            } else if (g_conf_data != nullptr) {
+                logger->SetSiteRateLimit(g_conf_data->site_rate_limit, g_conf_data->site_rate_burst);
+            }
+            return logger;
+        }
+
+        // 落地二进制帧而不是文本
+        void BuildBinaryMode(bool binary = true) { binary_ = binary; }
+
+        // 最低输出等级，不设置时取配置文件中的 log_level
+        void BuildLoggerLevel(LogLevel::value level)
+        {
+            level_ = level;
+            has_level_ = true;
+        }
+
+        // 积压溢出策略，不设置时取配置文件中的 overflow_policy
+        void BuildOverflowPolicy(OverflowPolicy policy)
+        {
+            overflow_policy_ = policy;
+            has_overflow_policy_ = true;
+        }
+
+        // *_LIMITED 宏的调用点限流，不设置时取配置文件中的 site_rate_limit/site_rate_burst
+        void BuildSiteRateLimit(double per_second, double burst)
+        {
+            site_rate_limit_ = per_second;
+            site_rate_burst_ = burst;
+            has_site_rate_limit_ = true;
         }
 
     protected:
+        bool binary_ = false;
+        bool has_overflow_policy_ = false;
+        OverflowPolicy overflow_policy_ = OverflowPolicy::BLOCK;
+        bool has_level_ = false;
+        LogLevel::value level_ = LogLevel::value::DEBUG;
+        bool has_site_rate_limit_ = false;
+        double site_rate_limit_ = 0;
+        double site_rate_burst_ = 1;
         std::string logger_name_ = "async_logger";
         std::vector<mylog::LogFlush::ptr> flushs_;
     };
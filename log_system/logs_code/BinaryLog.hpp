@@ -0,0 +1,449 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "Level.hpp"
+#include "Message.hpp"
+
+// 二进制延迟格式化日志
+// 每个调用点的格式串、文件名、行号在第一次执行时登记一次，得到一个静态的调用点id
+// 运行时只记录 调用点id + 时间戳 + 线程id + 按类型编码的参数，格式化推迟到离线解码(tools/mylog_decode)
+// 普通文本模式的日志器收到这类日志时，由格式化线程按格式串渲染成文本，结果和 printf 一致
+namespace mylog
+{
+    // 一个调用点的静态信息，登记后不再修改也不释放
+    struct BinarySite
+    {
+        LogLevel::value level;
+        const char* file;
+        uint32_t line;
+        const char* fmt;
+    };
+
+    // 全局调用点登记表，id 从1开始，0表示登记失败
+    class BinarySites
+    {
+    public:
+        static constexpr uint32_t kMaxSites = 1 << 16;
+
+        static uint32_t Register(LogLevel::value level, const char* file, uint32_t line, const char* fmt)
+        {
+            Table& t = Instance();
+            std::lock_guard<std::mutex> lock(t.mtx);
+            uint32_t id = t.count.load(std::memory_order_relaxed);
+            if (id >= kMaxSites) {
+                fprintf(stderr, "mylog: too many binary log sites, %s:%u ignored\n", file, line);
+                return 0;
+            }
+            t.sites[id].store(new BinarySite{level, file, line, fmt}, std::memory_order_release);
+            t.count.store(id + 1, std::memory_order_release);
+            return id;
+        }
+
+        // 已登记的 id 才能查询
+        static const BinarySite* Get(uint32_t id)
+        {
+            return Instance().sites[id].load(std::memory_order_acquire);
+        }
+
+        // 当前已登记的 id 上界(不含)
+        static uint32_t Count()
+        {
+            return Instance().count.load(std::memory_order_acquire);
+        }
+
+    private:
+        struct Table
+        {
+            std::mutex mtx;
+            std::atomic<uint32_t> count{1};
+            std::atomic<const BinarySite*> sites[kMaxSites] = {};
+        };
+
+        static Table& Instance()
+        {
+            static Table table;
+            return table;
+        }
+    };
+
+    // 参数编码：每个参数一个类型标记加定长或带长度的数据，按本机字节序
+    //   'i' 有符号整数(int64)   'u' 无符号整数(uint64)   'd' 浮点(double)
+    //   's' 字符串(uint32长度 + 内容)   'p' 指针(uint64)
+    class BinaryArgs
+    {
+    public:
+        template <typename... Args>
+        static size_t EncodedSize(const Args&... args)
+        {
+            return (SizeOf(args) + ... + 0);
+        }
+
+        // dst 至少要有 EncodedSize(args...) 字节，返回写完后的位置
+        template <typename... Args>
+        static char* Encode(char* dst, const Args&... args)
+        {
+            (EncodeOne(&dst, args), ...);
+            return dst;
+        }
+
+        template <typename... Args>
+        static void Encode(std::string* out, const Args&... args)
+        {
+            size_t old = out->size();
+            out->resize(old + EncodedSize(args...));
+            Encode(&(*out)[old], args...);
+        }
+
+        // 按 printf 的格式串把编码后的参数渲染成文本追加到 out
+        // 长度修饰符(h/l/ll/z...)被忽略，整数统一按64位、浮点统一按 double 输出
+        static void Render(const char* fmt, const char* args, size_t len, std::string* out)
+        {
+            Reader reader{args, args + len};
+            const char* p = fmt;
+            while (*p != '\0') {
+                if (*p != '%') {
+                    const char* next = strchr(p, '%');
+                    if (next == nullptr) next = p + strlen(p);
+                    out->append(p, next - p);
+                    p = next;
+                    continue;
+                }
+                if (p[1] == '%') {
+                    out->push_back('%');
+                    p += 2;
+                    continue;
+                }
+                p = RenderOne(p, &reader, out);
+            }
+        }
+
+        // 依次取出编码后的参数，结构化日志(Structured.hpp)渲染字段时也用它
+        struct Reader
+        {
+            const char* cur;
+            const char* end;
+
+            // 取下一个参数，类型不够或数据截断时返回0
+            char Next(int64_t* i, uint64_t* u, double* d, std::string_view* s)
+            {
+                if (cur >= end) return 0;
+                char tag = *cur++;
+                switch (tag) {
+                    case 'i':
+                    case 'u':
+                    case 'p':
+                    case 'd': {
+                        if (end - cur < 8) return 0;
+                        uint64_t raw;
+                        memcpy(&raw, cur, 8);
+                        cur += 8;
+                        *u = raw;
+                        *i = static_cast<int64_t>(raw);
+                        memcpy(d, &raw, 8);
+                        if (tag == 'd') {
+                            *i = static_cast<int64_t>(*d);
+                            *u = static_cast<uint64_t>(*i);
+                        }
+                        return tag;
+                    }
+                    case 's': {
+                        if (end - cur < 4) return 0;
+                        uint32_t n;
+                        memcpy(&n, cur, 4);
+                        cur += 4;
+                        if (static_cast<size_t>(end - cur) < n) return 0;
+                        *s = std::string_view(cur, n);
+                        cur += n;
+                        return tag;
+                    }
+                    default:
+                        cur = end; // 不认识的标记，后面的数据都无法解析
+                        return 0;
+                }
+            }
+        };
+
+    private:
+        template <typename T>
+        struct Unsupported : std::false_type {};
+
+        template <typename T>
+        static size_t SizeOf(const T& v)
+        {
+            using D = std::decay_t<T>;
+            if constexpr (std::is_same_v<D, const char*> || std::is_same_v<D, char*>) {
+                const char* s = v; // 字符串字面量是数组，先退化成指针再判空
+                return 5 + (s != nullptr ? strlen(s) : 6);
+            } else if constexpr (std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>) {
+                return 5 + v.size();
+            } else {
+                return 9;
+            }
+        }
+
+        static void PutFixed(char** out, char tag, uint64_t raw)
+        {
+            (*out)[0] = tag;
+            memcpy(*out + 1, &raw, 8);
+            *out += 9;
+        }
+
+        static void PutString(char** out, const char* s, size_t n)
+        {
+            uint32_t len = static_cast<uint32_t>(n);
+            (*out)[0] = 's';
+            memcpy(*out + 1, &len, 4);
+            memcpy(*out + 5, s, n);
+            *out += 5 + n;
+        }
+
+        template <typename T>
+        static void EncodeOne(char** out, const T& v)
+        {
+            using D = std::decay_t<T>;
+            if constexpr (std::is_same_v<D, bool>) {
+                PutFixed(out, 'i', v ? 1 : 0);
+            } else if constexpr (std::is_integral_v<D>) {
+                if constexpr (std::is_signed_v<D>) {
+                    PutFixed(out, 'i', static_cast<uint64_t>(static_cast<int64_t>(v)));
+                } else {
+                    PutFixed(out, 'u', static_cast<uint64_t>(v));
+                }
+            } else if constexpr (std::is_enum_v<D>) {
+                PutFixed(out, 'i', static_cast<uint64_t>(static_cast<int64_t>(v)));
+            } else if constexpr (std::is_floating_point_v<D>) {
+                double d = static_cast<double>(v);
+                uint64_t raw;
+                memcpy(&raw, &d, 8);
+                PutFixed(out, 'd', raw);
+            } else if constexpr (std::is_same_v<D, const char*> || std::is_same_v<D, char*>) {
+                const char* s = v;
+                if (s == nullptr) s = "(null)";
+                PutString(out, s, strlen(s));
+            } else if constexpr (std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>) {
+                PutString(out, v.data(), v.size());
+            } else if constexpr (std::is_pointer_v<D>) {
+                PutFixed(out, 'p', static_cast<uint64_t>(reinterpret_cast<uintptr_t>(v)));
+            } else {
+                static_assert(Unsupported<D>::value, "unsupported argument type for binary logging");
+            }
+        }
+
+        // 解析一个转换说明并输出，返回说明之后的位置
+        static const char* RenderOne(const char* p, Reader* reader, std::string* out)
+        {
+            const char* start = p++;
+            std::string spec = "%";
+            int64_t i = 0;
+            uint64_t u = 0;
+            double d = 0;
+            std::string_view s;
+            while (*p != '\0' && strchr("-+ #0'", *p) != nullptr) spec.push_back(*p++);
+            // 宽度和精度可以是 *，从参数里取
+            for (int part = 0; part < 2; ++part) {
+                if (part == 1) {
+                    if (*p != '.') break;
+                    spec.push_back(*p++);
+                }
+                if (*p == '*') {
+                    ++p;
+                    if (reader->Next(&i, &u, &d, &s) == 0) i = 0;
+                    spec += std::to_string(i);
+                } else {
+                    while (*p >= '0' && *p <= '9') spec.push_back(*p++);
+                }
+            }
+            while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr) ++p;
+            char conv = *p;
+            if (conv == '\0') {
+                out->append(start, p - start);
+                return p;
+            }
+            ++p;
+
+            char tag = reader->Next(&i, &u, &d, &s);
+            if (tag == 0) {
+                out->append(start, p - start); // 参数不够，原样输出转换说明
+                return p;
+            }
+            char buf[128];
+            int n = -1;
+            std::string str;
+            switch (conv) {
+                case 'd':
+                case 'i':
+                    spec += "lld";
+                    n = snprintf(buf, sizeof(buf), spec.c_str(), static_cast<long long>(i));
+                    break;
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X':
+                    spec += "ll";
+                    spec.push_back(conv);
+                    n = snprintf(buf, sizeof(buf), spec.c_str(), static_cast<unsigned long long>(u));
+                    break;
+                case 'c':
+                    spec.push_back('c');
+                    n = snprintf(buf, sizeof(buf), spec.c_str(), static_cast<int>(i));
+                    break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A':
+                    spec.push_back(conv);
+                    n = snprintf(buf, sizeof(buf), spec.c_str(), tag == 'd' ? d : static_cast<double>(i));
+                    break;
+                case 'p':
+                    spec.push_back('p');
+                    n = snprintf(buf, sizeof(buf), spec.c_str(), reinterpret_cast<void*>(static_cast<uintptr_t>(u)));
+                    break;
+                case 's':
+                    if (tag != 's') {
+                        out->append(start, p - start);
+                        return p;
+                    }
+                    if (spec == "%") {
+                        out->append(s.data(), s.size()); // 最常见的 %s 直接追加
+                        return p;
+                    }
+                    spec.push_back('s');
+                    str.assign(s.data(), s.size());
+                    n = snprintf(buf, sizeof(buf), spec.c_str(), str.c_str());
+                    break;
+                default:
+                    out->append(start, p - start);
+                    return p;
+            }
+            if (n < 0) return p;
+            if (static_cast<size_t>(n) < sizeof(buf)) {
+                out->append(buf, n);
+                return p;
+            }
+            // 宽度很大时输出超过栈上缓冲区，直接写进 out
+            size_t old = out->size();
+            out->resize(old + n + 1);
+            switch (conv) {
+                case 'd': case 'i': snprintf(&(*out)[old], n + 1, spec.c_str(), static_cast<long long>(i)); break;
+                case 'c': snprintf(&(*out)[old], n + 1, spec.c_str(), static_cast<int>(i)); break;
+                case 's': snprintf(&(*out)[old], n + 1, spec.c_str(), str.c_str()); break;
+                case 'p': snprintf(&(*out)[old], n + 1, spec.c_str(), reinterpret_cast<void*>(static_cast<uintptr_t>(u))); break;
+                case 'u': case 'o': case 'x': case 'X':
+                    snprintf(&(*out)[old], n + 1, spec.c_str(), static_cast<unsigned long long>(u));
+                    break;
+                default: snprintf(&(*out)[old], n + 1, spec.c_str(), tag == 'd' ? d : static_cast<double>(i)); break;
+            }
+            out->resize(old + n);
+            return p;
+        }
+    };
+
+    // 二进制日志文件由帧组成：类型(1字节) + 帧体长度(uint32) + 帧体，整数按本机字节序
+    //   'H' 文件头   magic "MYLOGBIN" + 版本(uint16) + 日志器名长度(uint16) + 日志器名
+    //   'S' 调用点   id(uint32) + 级别(uint8) + 行号(uint32) + 文件名长度(uint16) + 文件名 + 格式串长度(uint32) + 格式串
+    //   'R' 记录     调用点id(uint32) + 时间戳(int64) + 线程id(uint64) + 编码后的参数
+    //   'T' 文本记录 级别(uint8) + 行号(uint32) + 时间戳(int64) + 线程id(uint64) + 文件名长度(uint16) + 文件名 + 正文
+    //   'K' 结构化记录 和 'T' 相同，正文是编码后的事件名和字段(Structured.hpp)
+    // 调用点帧总是先于引用它的记录写出；不认识的帧类型可以按长度跳过
+    // 滚动的落地器在每个分段开头重写文件头和完整的调用点表，同一个调用点可能出现多次，内容相同
+    class BinaryFrame
+    {
+    public:
+        static constexpr char kMagic[8] = {'M', 'Y', 'L', 'O', 'G', 'B', 'I', 'N'};
+        static constexpr uint16_t kVersion = 1;
+        static constexpr size_t kFrameHeadSize = 5;
+
+        static void AppendHeader(const std::string& logger_name, std::string* out)
+        {
+            size_t body = Begin('H', out);
+            out->append(kMagic, sizeof(kMagic));
+            Put<uint16_t>(kVersion, out);
+            Put<uint16_t>(static_cast<uint16_t>(logger_name.size()), out);
+            out->append(logger_name);
+            End(body, out);
+        }
+
+        // 文件头加上目前登记过的所有调用点，滚动出的每个新分段都以它开头
+        static void AppendPreamble(const std::string& logger_name, std::string* out)
+        {
+            AppendHeader(logger_name, out);
+            uint32_t count = BinarySites::Count();
+            for (uint32_t id = 1; id < count; ++id) {
+                const BinarySite* site = BinarySites::Get(id);
+                if (site != nullptr) AppendSite(id, *site, out);
+            }
+        }
+
+        static void AppendSite(uint32_t id, const BinarySite& site, std::string* out)
+        {
+            size_t body = Begin('S', out);
+            size_t file_len = strlen(site.file);
+            size_t fmt_len = strlen(site.fmt);
+            Put<uint32_t>(id, out);
+            Put<uint8_t>(static_cast<uint8_t>(site.level), out);
+            Put<uint32_t>(site.line, out);
+            Put<uint16_t>(static_cast<uint16_t>(file_len), out);
+            out->append(site.file, file_len);
+            Put<uint32_t>(static_cast<uint32_t>(fmt_len), out);
+            out->append(site.fmt, fmt_len);
+            End(body, out);
+        }
+
+        // 按日志的来源写成 'R'、'T' 或 'K' 帧
+        static void AppendMessage(const LogMessage& msg, std::string* out)
+        {
+            if (msg.site_id_ != 0) {
+                size_t body = Begin('R', out);
+                Put<uint32_t>(msg.site_id_, out);
+                Put<int64_t>(static_cast<int64_t>(msg.ctime_), out);
+                Put<uint64_t>(msg.tid_, out);
+                out->append(msg.Payload().data(), msg.Payload().size());
+                End(body, out);
+                return;
+            }
+            size_t body = Begin(msg.structured_ ? 'K' : 'T', out);
+            Put<uint8_t>(static_cast<uint8_t>(msg.level_), out);
+            Put<uint32_t>(static_cast<uint32_t>(msg.line_), out);
+            Put<int64_t>(static_cast<int64_t>(msg.ctime_), out);
+            Put<uint64_t>(msg.tid_, out);
+            size_t file_len = strlen(msg.file_name_);
+            Put<uint16_t>(static_cast<uint16_t>(file_len), out);
+            out->append(msg.file_name_, file_len);
+            out->append(msg.Payload().data(), msg.Payload().size());
+            End(body, out);
+        }
+
+    private:
+        template <typename T>
+        static void Put(T v, std::string* out)
+        {
+            out->append(reinterpret_cast<const char*>(&v), sizeof(v));
+        }
+
+        // 先占住帧头，帧体写完后回填长度
+        static size_t Begin(char type, std::string* out)
+        {
+            out->push_back(type);
+            out->append(4, '\0');
+            return out->size();
+        }
+
+        static void End(size_t body_start, std::string* out)
+        {
+            uint32_t len = static_cast<uint32_t>(out->size() - body_start);
+            memcpy(&(*out)[body_start - 4], &len, 4);
+        }
+    };
+} // namespace mylog
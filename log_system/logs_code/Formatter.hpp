@@ -0,0 +1,193 @@
+#pragma once
+
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "BinaryLog.hpp"
+#include "Level.hpp"
+#include "Message.hpp"
+#include "Structured.hpp"
+
+namespace mylog
+{
+    // 日志格式化器：构造时把格式串编译成一串操作，格式化时依次执行，直接追加到调用方提供的缓冲区
+    // 调用方复用同一个缓冲区时，每行日志不再有堆分配
+    // 支持的占位符：
+    //   %T 时间(时:分:秒)   %t 线程id    %l 日志级别   %c 日志器名
+    //   %f 文件名           %L 行号      %m 日志正文   %n 换行     %% 百分号
+    // 其他字符原样输出，不认识的占位符也原样输出
+    // 结构化日志的 %m 渲染成 logfmt；structured 为 JSON 时结构化日志整行输出成一个 JSON 对象，不套用格式
+    class Formatter
+    {
+    public:
+        // 和之前固定的格式一致: [时间][线程ID][日志级别][日志器名][文件名:行号] <Tab> 日志正文 <换行>
+        static constexpr const char* kDefaultPattern = "[%T][%t][%l][%c][%f:%L]\t%m%n";
+
+        explicit Formatter(const std::string& pattern = kDefaultPattern,
+                           StructuredFormat structured = StructuredFormat::LOGFMT)
+            : pattern_(pattern), structured_(structured)
+        {
+            Compile(pattern);
+        }
+
+        const std::string& Pattern() const { return pattern_; }
+
+        // 把 msg 按格式追加到 out 末尾
+        void Format(const LogMessage& msg, std::string* out) const
+        {
+            if (msg.structured_ && structured_ == StructuredFormat::JSON) {
+                StructuredFields::RenderJson(msg, out);
+                return;
+            }
+            // 二进制日志的文件名、行号和格式串在调用点登记表里
+            const BinarySite* site = msg.site_id_ != 0 ? BinarySites::Get(msg.site_id_) : nullptr;
+            for (const auto& op : ops_) {
+                switch (op.type) {
+                    case OpType::LITERAL:
+                        out->append(op.text);
+                        break;
+                    case OpType::TIME:
+                        AppendTime(msg.ctime_, out);
+                        break;
+                    case OpType::TID:
+                        AppendTid(msg.tid_, out);
+                        break;
+                    case OpType::LEVEL:
+                        out->append(LogLevel::ToString(msg.level_));
+                        break;
+                    case OpType::LOGGER:
+                        out->append(msg.name_);
+                        break;
+                    case OpType::FILE:
+                        if (site != nullptr) out->append(site->file);
+                        else out->append(msg.file_name_);
+                        break;
+                    case OpType::LINE:
+                        AppendNumber(site != nullptr ? site->line : msg.line_, out);
+                        break;
+                    case OpType::MESSAGE:
+                        if (site != nullptr) BinaryArgs::Render(site->fmt, msg.Payload().data(), msg.Payload().size(), out);
+                        else if (msg.structured_) StructuredFields::RenderLogfmt(msg.Payload(), out);
+                        else out->append(msg.Payload().data(), msg.Payload().size());
+                        break;
+                    case OpType::NEWLINE:
+                        out->push_back('\n');
+                        break;
+                }
+            }
+        }
+
+        std::string Format(const LogMessage& msg) const
+        {
+            std::string ret;
+            Format(msg, &ret);
+            return ret;
+        }
+
+    private:
+        enum class OpType { LITERAL, TIME, TID, LEVEL, LOGGER, FILE, LINE, MESSAGE, NEWLINE };
+
+        struct Op
+        {
+            OpType type;
+            std::string text; // 仅 LITERAL 使用
+        };
+
+        void Compile(const std::string& pattern)
+        {
+            std::string literal;
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                if (pattern[i] != '%' || i + 1 == pattern.size()) {
+                    literal.push_back(pattern[i]);
+                    continue;
+                }
+                char c = pattern[++i];
+                OpType type;
+                switch (c) {
+                    case 'T': type = OpType::TIME; break;
+                    case 't': type = OpType::TID; break;
+                    case 'l': type = OpType::LEVEL; break;
+                    case 'c': type = OpType::LOGGER; break;
+                    case 'f': type = OpType::FILE; break;
+                    case 'L': type = OpType::LINE; break;
+                    case 'm': type = OpType::MESSAGE; break;
+                    case 'n': type = OpType::NEWLINE; break;
+                    case '%':
+                        literal.push_back('%');
+                        continue;
+                    default:
+                        literal.push_back('%');
+                        literal.push_back(c);
+                        continue;
+                }
+                // 相邻的普通字符合并成一个 LITERAL 操作
+                if (!literal.empty()) {
+                    ops_.push_back(Op{OpType::LITERAL, std::move(literal)});
+                    literal.clear();
+                }
+                ops_.push_back(Op{type, std::string()});
+            }
+            if (!literal.empty()) {
+                ops_.push_back(Op{OpType::LITERAL, std::move(literal)});
+            }
+        }
+
+        // 同一秒内的日志共用一次 localtime_r 的结果，按格式化线程各缓存一份
+        static void AppendTime(time_t now, std::string* out)
+        {
+            struct TimeCache
+            {
+                time_t sec = -1;
+                char text[8];
+            };
+            thread_local TimeCache cache;
+            if (cache.sec != now) {
+                struct tm t;
+                localtime_r(&now, &t);
+                cache.text[0] = '0' + t.tm_hour / 10;
+                cache.text[1] = '0' + t.tm_hour % 10;
+                cache.text[2] = ':';
+                cache.text[3] = '0' + t.tm_min / 10;
+                cache.text[4] = '0' + t.tm_min % 10;
+                cache.text[5] = ':';
+                cache.text[6] = '0' + t.tm_sec / 10;
+                cache.text[7] = '0' + t.tm_sec % 10;
+                cache.sec = now;
+            }
+            out->append(cache.text, sizeof(cache.text));
+        }
+
+        // 批次里相邻的日志大多来自同一个线程，缓存上一次转换的线程id
+        static void AppendTid(uint64_t tid, std::string* out)
+        {
+            struct TidCache
+            {
+                uint64_t tid = 0;
+                char text[20];
+                size_t len = 0;
+            };
+            thread_local TidCache cache;
+            if (cache.len == 0 || cache.tid != tid) {
+                auto res = std::to_chars(cache.text, cache.text + sizeof(cache.text), tid);
+                cache.len = res.ptr - cache.text;
+                cache.tid = tid;
+            }
+            out->append(cache.text, cache.len);
+        }
+
+        static void AppendNumber(uint64_t value, std::string* out)
+        {
+            char buf[20];
+            auto res = std::to_chars(buf, buf + sizeof(buf), value);
+            out->append(buf, res.ptr - buf);
+        }
+
+    private:
+        std::string pattern_;
+        StructuredFormat structured_;
+        std::vector<Op> ops_;
+    };
+} // namespace mylog
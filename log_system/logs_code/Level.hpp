@@ -1,4 +1,5 @@
 #pragma once
+#include <cctype>
 #include <string>
 
 namespace mylog {
@@ -24,5 +25,17 @@ class LogLevel {
         }
         return "UNKNOW";
     }
+
+    // 配置文件中的等级名转成枚举，不区分大小写，无法识别时返回 def
+    static value FromString(const std::string& name, value def) {
+        std::string upper(name);
+        for (auto& c : upper) c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        if (upper == "DEBUG") return value::DEBUG;
+        if (upper == "INFO") return value::INFO;
+        if (upper == "WARN") return value::WARN;
+        if (upper == "ERROR") return value::ERROR;
+        if (upper == "FATAL") return value::FATAL;
+        return def;
+    }
 };
 }  // namespace mylog
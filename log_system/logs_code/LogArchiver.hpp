@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+#include "Util.hpp"
+
+extern mylog::Util::JsonData* g_conf_data;
+namespace mylog
+{
+    // 滚动落地器的后台归档：把已关闭的分段压缩成 .gz，并按总大小和时间清理旧分段
+    // 落地器滚动时只把旧文件名放进队列，压缩和清理都在一个低优先级(CPU nice 19、IO idle)的线程里做，
+    // 不占用写日志的线程
+    // 停止时正在压缩的文件放弃(源文件保留)，下次启动时和上次崩溃留下的分段一起补做
+    class LogArchiver
+    {
+    public:
+        // basename 与落地器的文件名前缀相同，归档只处理这个前缀下的文件
+        explicit LogArchiver(const std::string& basename)
+            : dir_(Util::File::Path(basename)),
+              prefix_(basename.substr(dir_.size())),
+              started_(std::chrono::system_clock::now())
+        {
+            if (dir_.empty()) dir_ = "./";
+            if (g_conf_data != nullptr) {
+                compress_ = g_conf_data->compress_rolled;
+                retention_bytes_ = g_conf_data->retention_bytes;
+                retention_age_ = std::chrono::hours(g_conf_data->retention_hours);
+            }
+            if (compress_ || retention_bytes_ > 0 || retention_age_.count() > 0) {
+                thread_ = std::thread(&LogArchiver::ArchiverThreadEntry, this);
+            }
+        }
+
+        ~LogArchiver()
+        {
+            if (!thread_.joinable()) return;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stop_ = true;
+            }
+            cond_.notify_all();
+            thread_.join();
+        }
+
+        LogArchiver(const LogArchiver&) = delete;
+        LogArchiver& operator=(const LogArchiver&) = delete;
+
+        // 落地器关闭一个分段后调用，只是入队
+        void Submit(const std::string& filename)
+        {
+            if (!thread_.joinable()) return;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                pending_.push_back(filename);
+            }
+            cond_.notify_all();
+        }
+
+    private:
+        static constexpr size_t kChunkSize = 256 * 1024;
+        static constexpr std::chrono::minutes kRetentionInterval{1}; // 没有新分段时也定期按时间清理
+
+        struct Segment
+        {
+            std::string path;
+            size_t size;
+            time_t mtime;
+        };
+
+        void ArchiverThreadEntry()
+        {
+            // Linux 上 nice 值和 IO 优先级都可以按线程设置
+            pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+            setpriority(PRIO_PROCESS, tid, 19);
+#ifdef SYS_ioprio_set
+            const int kIoprioClassIdle = 3, kIoprioClassShift = 13, kIoprioWhoProcess = 1;
+            syscall(SYS_ioprio_set, kIoprioWhoProcess, tid, kIoprioClassIdle << kIoprioClassShift);
+#endif
+            RecoverLeftovers();
+
+            std::unique_lock<std::mutex> lock(mtx_);
+            while (!stop_) {
+                if (pending_.empty()) {
+                    lock.unlock();
+                    EnforceRetention();
+                    lock.lock();
+                    cond_.wait_for(lock, kRetentionInterval, [this] { return stop_ || !pending_.empty(); });
+                    continue;
+                }
+                std::string path = std::move(pending_.front());
+                pending_.pop_front();
+                lock.unlock();
+                if (compress_) {
+                    Compress(path);
+                } else {
+                    std::lock_guard<std::mutex> closed_lock(mtx_closed_);
+                    closed_.push_back(path);
+                }
+                lock.lock();
+            }
+        }
+
+        // 上次运行留下的未压缩分段和压缩了一半的临时文件
+        // 只看本归档器启动之前修改过的文件，避免碰到落地器刚建好的分段
+        void RecoverLeftovers()
+        {
+            for (const std::string& name : ListPrefixed()) {
+                std::string path = dir_ + name;
+                struct stat st;
+                if (stat(path.c_str(), &st) != 0) continue;
+                auto mtime = std::chrono::system_clock::from_time_t(st.st_mtim.tv_sec) +
+                             std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                 std::chrono::nanoseconds(st.st_mtim.tv_nsec));
+                if (mtime >= started_) continue;
+                if (EndsWith(name, ".gz.tmp")) {
+                    unlink(path.c_str());
+                } else if (!EndsWith(name, ".gz")) {
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    pending_.push_back(path);
+                }
+            }
+        }
+
+        // 压缩成 path.gz，先写临时文件再改名，完成后删除源文件
+        void Compress(const std::string& path)
+        {
+            FILE* in = fopen(path.c_str(), "rb");
+            if (in == NULL) return;
+            std::string tmp = path + ".gz.tmp";
+            gzFile out = gzopen(tmp.c_str(), "wb6");
+            if (out == NULL) {
+                fclose(in);
+                std::cout << __FILE__ << __LINE__ << "open " << tmp << " failed" << std::endl;
+                return;
+            }
+            std::vector<char> buf(kChunkSize);
+            bool ok = true;
+            size_t n;
+            while ((n = fread(buf.data(), 1, buf.size(), in)) > 0) {
+                if (gzwrite(out, buf.data(), static_cast<unsigned>(n)) != static_cast<int>(n)) {
+                    ok = false;
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (stop_) {
+                    ok = false;
+                    break;
+                }
+            }
+            ok = !ferror(in) && ok;
+            fclose(in);
+            ok = gzclose(out) == Z_OK && ok;
+            if (ok && rename(tmp.c_str(), (path + ".gz").c_str()) == 0) {
+                unlink(path.c_str());
+            } else {
+                unlink(tmp.c_str());
+            }
+        }
+
+        // 已关闭的分段从旧到新删除，直到总大小和时间都满足保留策略
+        void EnforceRetention()
+        {
+            if (retention_bytes_ == 0 && retention_age_.count() == 0) return;
+            std::vector<Segment> segments;
+            for (const std::string& name : ListPrefixed()) {
+                if (EndsWith(name, ".gz")) AddSegment(dir_ + name, &segments);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mtx_closed_);
+                std::vector<std::string> alive;
+                for (const std::string& path : closed_) {
+                    if (AddSegment(path, &segments)) alive.push_back(path);
+                }
+                closed_.swap(alive);
+            }
+            std::sort(segments.begin(), segments.end(),
+                      [](const Segment& a, const Segment& b) { return a.mtime < b.mtime; });
+
+            size_t total = 0;
+            for (const Segment& seg : segments) total += seg.size;
+            time_t oldest_kept = Util::Date::Now() - static_cast<time_t>(
+                std::chrono::duration_cast<std::chrono::seconds>(retention_age_).count());
+            for (const Segment& seg : segments) {
+                bool over_size = retention_bytes_ > 0 && total > retention_bytes_;
+                bool too_old = retention_age_.count() > 0 && seg.mtime < oldest_kept;
+                if (!over_size && !too_old) break;
+                if (unlink(seg.path.c_str()) == 0) total -= seg.size;
+            }
+        }
+
+        static bool AddSegment(const std::string& path, std::vector<Segment>* segments)
+        {
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) return false;
+            segments->push_back(Segment{path, static_cast<size_t>(st.st_size), st.st_mtime});
+            return true;
+        }
+
+        // 本落地器产生的分段(及其 .gz/.gz.tmp)，同一目录下其它日志器的文件不算，即使前缀相同
+        std::vector<std::string> ListPrefixed() const
+        {
+            std::vector<std::string> names;
+            DIR* dir = opendir(dir_.c_str());
+            if (dir == NULL) return names;
+            while (struct dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (IsSegmentName(name)) {
+                    names.push_back(name);
+                }
+            }
+            closedir(dir);
+            return names;
+        }
+
+        // 和落地器的 CreateFilename 对应：前缀 + 日期数字 + "-序号.log"，
+        // 之后可能有同名时加的 ".数字"，以及归档加的 ".gz" 或 ".gz.tmp"
+        bool IsSegmentName(const std::string& name) const
+        {
+            if (name.compare(0, prefix_.size(), prefix_) != 0) return false;
+            size_t pos = prefix_.size();
+            size_t date_end = name.find('-', pos);
+            if (date_end == std::string::npos || !IsDate(name.substr(pos, date_end - pos))) return false;
+            pos = date_end + 1;
+            if (SkipDigits(name, &pos) == 0 || name.compare(pos, 4, ".log") != 0) return false;
+            pos += 4;
+            if (pos < name.size() && name[pos] == '.' && pos + 1 < name.size() && isdigit(name[pos + 1])) {
+                ++pos;
+                SkipDigits(name, &pos);
+            }
+            std::string rest = name.substr(pos);
+            return rest.empty() || rest == ".gz" || rest == ".gz.tmp";
+        }
+
+        static size_t SkipDigits(const std::string& s, size_t* pos)
+        {
+            size_t start = *pos;
+            while (*pos < s.size() && isdigit(static_cast<unsigned char>(s[*pos]))) ++*pos;
+            return *pos - start;
+        }
+
+        // 4位年份后依次是 月、日、时+1、分+1、秒+1，各1~2位且没有前导0
+        // 只要存在一种合法的切分就算日期，这样前缀是另一个前缀加数字的日志器(app 和 app2)不会混在一起
+        static bool IsDate(const std::string& digits)
+        {
+            if (digits.size() < 9 || digits.size() > 14) return false;
+            for (char c : digits) {
+                if (!isdigit(static_cast<unsigned char>(c))) return false;
+            }
+            int year = atoi(digits.substr(0, 4).c_str());
+            return year >= 1970 && MatchFields(digits, 4, 0);
+        }
+
+        static bool MatchFields(const std::string& digits, size_t pos, int field)
+        {
+            static const int kMax[] = {12, 31, 24, 60, 61};
+            if (field == 5) return pos == digits.size();
+            for (size_t len = 1; len <= 2 && pos + len <= digits.size(); ++len) {
+                if (len == 2 && digits[pos] == '0') break;
+                int v = atoi(digits.substr(pos, len).c_str());
+                if (v >= 1 && v <= kMax[field] && MatchFields(digits, pos + len, field + 1)) return true;
+            }
+            return false;
+        }
+
+        static bool EndsWith(const std::string& s, const char* suffix)
+        {
+            size_t n = strlen(suffix);
+            return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+        }
+
+    private:
+        std::string dir_;     // 以 / 结尾
+        std::string prefix_;  // 分段文件名的公共前缀
+        const std::chrono::system_clock::time_point started_;
+        bool compress_ = false;
+        size_t retention_bytes_ = 0;        // 已关闭分段的总大小上限，0 表示不限
+        std::chrono::hours retention_age_{0}; // 已关闭分段最多保留多久，0 表示不限
+
+        std::mutex mtx_;
+        std::condition_variable cond_;
+        std::deque<std::string> pending_; // 等待压缩的分段
+        bool stop_ = false;
+
+        std::mutex mtx_closed_;
+        std::vector<std::string> closed_; // 不压缩时已关闭的分段，参与保留策略
+
+        std::thread thread_;
+    };
+} // namespace mylog
@@ -1,8 +1,22 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sys/mman.h>
 #include <unistd.h>
+#include "LogArchiver.hpp"
 #include "Util.hpp"
 
 extern mylog::Util::JsonData* g_conf_data;
@@ -13,6 +27,14 @@ namespace mylog{
         using ptr = std::shared_ptr<LogFlush>;
         virtual ~LogFlush() {}
         virtual void Flush(const char *data, size_t len) = 0;//不同的写文件方式Flush的实现不同
+
+        // 滚动的落地器在每个新分段开头写入的内容，由二进制模式的流水线设置成文件头和完整的调用点表，
+        // 这样每个分段都能单独解码。在落地器开始写之前设置
+        using SegmentPreamble = std::function<void(std::string *)>;
+        void SetSegmentPreamble(SegmentPreamble preamble) { preamble_ = std::move(preamble); }
+
+    protected:
+        SegmentPreamble preamble_;
     };
 
     class StdoutFlush : public LogFlush
@@ -23,6 +45,173 @@ namespace mylog{
             cout.write(data, len);
         }
     };
+    // flush_log 为 2 时文件落地器的组提交同步
+    // 每批日志照常 fflush 到内核，fdatasync 则攒起来做：距第一笔未同步的写入超过 sync_interval_ms，
+    // 或未同步的数据超过 sync_bytes 时才同步一次。两个都配成 0 时退化为每批同步一次
+    // sync_thread 为 true 时由专门的线程同步，IO线程只登记写入量，不会被磁盘卡住
+    // 进程崩溃不丢日志(已在内核中)，掉电最多丢最近 sync_interval_ms 内的日志，实际的最坏值见 Report()
+    class GroupSync
+    {
+    public:
+        GroupSync()
+        {
+            if (g_conf_data != nullptr) {
+                enabled_ = g_conf_data->flush_log == 2;
+                interval_ = std::chrono::milliseconds(g_conf_data->sync_interval_ms);
+                sync_bytes_ = g_conf_data->sync_bytes;
+                use_thread_ = g_conf_data->sync_thread;
+            }
+            if (enabled_ && use_thread_) {
+                thread_ = std::thread(&GroupSync::SyncThreadEntry, this);
+            }
+        }
+
+        ~GroupSync()
+        {
+            if (!thread_.joinable()) return;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stop_ = true;
+            }
+            cond_.notify_all();
+            thread_.join();
+        }
+
+        GroupSync(const GroupSync&) = delete;
+        GroupSync& operator=(const GroupSync&) = delete;
+
+        bool Enabled() const { return enabled_; }
+
+        // 开始同步一个新打开的文件
+        void Attach(int fd)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            fd_ = fd;
+        }
+
+        // 关闭文件前调用：等正在进行的同步结束，再把剩下的数据同步掉
+        void Detach()
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cond_.wait(lock, [this] { return !syncing_; });
+            if (enabled_ && dirty_ && fd_ >= 0) {
+                SyncLocked(lock);
+            }
+            fd_ = -1;
+        }
+
+        // IO线程写完一批(已 fflush)后调用
+        void OnWrite(size_t len)
+        {
+            if (!enabled_) return;
+            std::unique_lock<std::mutex> lock(mtx_);
+            bool notify = false;
+            if (!dirty_) {
+                dirty_ = true;
+                dirty_since_ = std::chrono::steady_clock::now();
+                notify = true; // 同步线程据此开始计时
+            }
+            dirty_bytes_ += len;
+            bool due = Due(std::chrono::steady_clock::now());
+            if (!use_thread_) {
+                if (due && !syncing_) SyncLocked(lock);
+            } else if (notify || due) {
+                cond_.notify_all();
+            }
+        }
+
+        // 同步次数、观测到的最坏丢失窗口和 fdatasync 耗时分布
+        std::string Report() const
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            char buf[512];
+            snprintf(buf, sizeof(buf),
+                     "group sync: %llu fdatasync (interval %lld ms, %zu bytes, %s), worst loss window %.3f ms, "
+                     "latency <100us:%llu <1ms:%llu <10ms:%llu <100ms:%llu >=100ms:%llu",
+                     static_cast<unsigned long long>(sync_count_), static_cast<long long>(interval_.count()),
+                     sync_bytes_, use_thread_ ? "sync thread" : "inline",
+                     std::chrono::duration<double, std::milli>(worst_window_).count(),
+                     static_cast<unsigned long long>(latency_hist_[0]), static_cast<unsigned long long>(latency_hist_[1]),
+                     static_cast<unsigned long long>(latency_hist_[2]), static_cast<unsigned long long>(latency_hist_[3]),
+                     static_cast<unsigned long long>(latency_hist_[4]));
+            return buf;
+        }
+
+    private:
+        bool Due(std::chrono::steady_clock::time_point now) const
+        {
+            if (interval_.count() == 0 && sync_bytes_ == 0) return true;
+            if (sync_bytes_ > 0 && dirty_bytes_ >= sync_bytes_) return true;
+            return interval_.count() > 0 && now - dirty_since_ >= interval_;
+        }
+
+        // 持锁调用，fdatasync 期间放开锁，新的写入算进下一次同步
+        void SyncLocked(std::unique_lock<std::mutex>& lock)
+        {
+            const int fd = fd_;
+            const auto since = dirty_since_;
+            dirty_ = false;
+            dirty_bytes_ = 0;
+            syncing_ = true;
+            lock.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+            int ret = fdatasync(fd);
+            auto end = std::chrono::steady_clock::now();
+
+            lock.lock();
+            syncing_ = false;
+            if (ret != 0) {
+                std::cout << __FILE__ << __LINE__ << "fdatasync failed" << std::endl;
+                perror(NULL);
+            }
+            ++sync_count_;
+            worst_window_ = std::max(worst_window_, std::chrono::duration_cast<std::chrono::microseconds>(end - since));
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            size_t bucket = us < 100 ? 0 : us < 1000 ? 1 : us < 10000 ? 2 : us < 100000 ? 3 : 4;
+            ++latency_hist_[bucket];
+            cond_.notify_all(); // Detach 可能在等
+        }
+
+        void SyncThreadEntry()
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            while (!stop_) {
+                if (!dirty_ || fd_ < 0 || syncing_) {
+                    cond_.wait(lock);
+                    continue;
+                }
+                if (Due(std::chrono::steady_clock::now())) {
+                    SyncLocked(lock);
+                } else if (interval_.count() > 0) {
+                    cond_.wait_until(lock, dirty_since_ + interval_);
+                } else {
+                    cond_.wait(lock); // 只按字节数触发，等写入方通知
+                }
+            }
+        }
+
+    private:
+        bool enabled_ = false;
+        bool use_thread_ = true;
+        std::chrono::milliseconds interval_{100};
+        size_t sync_bytes_ = 4 * 1024 * 1024;
+
+        mutable std::mutex mtx_;
+        std::condition_variable cond_;
+        std::thread thread_;
+        bool stop_ = false;
+        int fd_ = -1;
+        bool dirty_ = false;     // 有已写入内核但未同步的数据
+        bool syncing_ = false;
+        size_t dirty_bytes_ = 0;
+        std::chrono::steady_clock::time_point dirty_since_; // 第一笔未同步写入的时间
+
+        uint64_t sync_count_ = 0;
+        std::chrono::microseconds worst_window_{0};
+        uint64_t latency_hist_[5] = {0, 0, 0, 0, 0};
+    };
+
     class FileFlush : public LogFlush
     {
     public:
@@ -36,6 +225,16 @@ namespace mylog{
             if(fs_==NULL){
                 std::cout <<__FILE__<<__LINE__<<"open log file failed"<< std::endl;
                 perror(NULL);
+            }else{
+                sync_.Attach(fileno(fs_));
+            }
+        }
+        ~FileFlush() override
+        {
+            if(fs_!=NULL){
+                fflush(fs_);
+                sync_.Detach();
+                fclose(fs_);
             }
         }
         void Flush(const char *data, size_t len) override{
@@ -50,14 +249,18 @@ namespace mylog{
                     perror(NULL);
                 }
             }else if(g_conf_data->flush_log == 2){
+                // 每批都进内核，磁盘同步按组提交策略进行
                 fflush(fs_);
-                fsync(fileno(fs_));
+                sync_.OnWrite(len);
             }
         }
 
+        std::string SyncReport() const { return sync_.Report(); }
+
     private:
         std::string filename_;
         FILE* fs_ = NULL; 
+        GroupSync sync_;
     };
 
     class RollFileFlush : public LogFlush
@@ -65,10 +268,18 @@ namespace mylog{
     public:
         using ptr = std::shared_ptr<RollFileFlush>;
         RollFileFlush(const std::string &filename, size_t max_size)
-            : max_size_(max_size), basename_(filename)
+            : max_size_(max_size), basename_(filename), archiver_(filename)
         {
             Util::File::CreateDirectory(Util::File::Path(filename));
         }
+        ~RollFileFlush() override
+        {
+            if(fs_!=NULL){
+                fflush(fs_);
+                sync_.Detach();
+                fclose(fs_);
+            }
+        }
 
         void Flush(const char *data, size_t len) override
         {
@@ -88,26 +299,40 @@ namespace mylog{
                 }
             }else if(g_conf_data->flush_log == 2){
                 fflush(fs_);
-                fsync(fileno(fs_));
+                sync_.OnWrite(len);
             }
         }
 
+        std::string SyncReport() const { return sync_.Report(); }
+
     private:
         void InitLogFile()
         {
             if (fs_==NULL || cur_size_ >= max_size_)
             {
                 if(fs_!=NULL){
+                    // 旧文件关闭前把没同步的部分同步掉
+                    fflush(fs_);
+                    sync_.Detach();
                     fclose(fs_);
                     fs_=NULL;
+                    archiver_.Submit(filename_); // 后台压缩和清理
                 }   
-                std::string filename = CreateFilename();
-                fs_=fopen(filename.c_str(), "ab");
+                filename_ = CreateFilename();
+                fs_=fopen(filename_.c_str(), "ab");
+                cur_size_ = 0;
                 if(fs_==NULL){
                     std::cout <<__FILE__<<__LINE__<<"open file failed"<< std::endl;
                     perror(NULL);
+                }else{
+                    sync_.Attach(fileno(fs_));
+                    if(preamble_){
+                        std::string preamble;
+                        preamble_(&preamble);
+                        fwrite(preamble.data(), 1, preamble.size(), fs_);
+                        cur_size_ = preamble.size();
+                    }
                 }
-                cur_size_ = 0;
             }
         }
         //构建日志名称
@@ -132,8 +357,172 @@ namespace mylog{
         size_t cur_size_ = 0;
         size_t max_size_;
         std::string basename_;
+        std::string filename_; // 当前正在写的文件
         // std::ofstream ofs_;
         FILE* fs_ = NULL;
+        GroupSync sync_;
+        LogArchiver archiver_;
+    };
+
+    // 内存映射的滚动文件落地器
+    // 每个分段文件预先 fallocate 到 segment_size 并整段映射，IO线程把一批日志直接拷进映射区，
+    // 没有 stdio 缓冲区的拷贝，也没有每批一次的 write 系统调用
+    // 拷进映射区的数据已经在页缓存里，进程崩溃也不会丢；flush_log 为 2 时按 GroupSync 的策略同步到磁盘
+    // 下一个分段在后台提前创建好，滚动时直接换上；分段关闭时截掉未写入的尾部
+    class MmapFileFlush : public LogFlush
+    {
+    public:
+        using ptr = std::shared_ptr<MmapFileFlush>;
+        MmapFileFlush(const std::string &filename, size_t segment_size)
+            : segment_size_(segment_size), basename_(filename), archiver_(filename)
+        {
+            Util::File::CreateDirectory(Util::File::Path(filename));
+            next_ = std::async(std::launch::async, &MmapFileFlush::CreateSegment, CreateFilename(), segment_size_);
+        }
+        ~MmapFileFlush() override
+        {
+            CloseSegment();
+            if (next_.valid()) {
+                DiscardSegment(next_.get()); // 预建了没用上的分段
+            }
+        }
+
+        void Flush(const char *data, size_t len) override
+        {
+            if (cur_.addr == nullptr || used_ + len > cur_.size) {
+                Roll(len);
+                if (cur_.addr == nullptr) return; // 创建分段失败，错误已输出
+            }
+            memcpy(cur_.addr + used_, data, len);
+            used_ += len;
+            sync_.OnWrite(len);
+        }
+
+        std::string SyncReport() const { return sync_.Report(); }
+
+    private:
+        struct Segment
+        {
+            int fd = -1;
+            char *addr = nullptr;
+            size_t size = 0;
+            std::string filename;
+        };
+
+        // 创建并映射一个分段
+        static Segment CreateSegment(std::string filename, size_t size)
+        {
+            Segment seg;
+            const std::string name = filename;
+            int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            for (int i = 1; fd < 0 && errno == EEXIST; ++i) {
+                // 同一秒内重启时文件名可能重复，不能覆盖已有的日志
+                filename = name + "." + std::to_string(i);
+                fd = open(filename.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            }
+            if (fd < 0) {
+                std::cout << __FILE__ << __LINE__ << "open file failed" << std::endl;
+                perror(NULL);
+                return seg;
+            }
+            // 文件系统不支持预分配时退回到 ftruncate，得到的是稀疏文件
+            if (posix_fallocate(fd, 0, size) != 0 && ftruncate(fd, size) != 0) {
+                std::cout << __FILE__ << __LINE__ << "allocate file failed" << std::endl;
+                perror(NULL);
+                close(fd);
+                unlink(filename.c_str());
+                return seg;
+            }
+            void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                std::cout << __FILE__ << __LINE__ << "mmap file failed" << std::endl;
+                perror(NULL);
+                close(fd);
+                unlink(filename.c_str());
+                return seg;
+            }
+            seg.fd = fd;
+            seg.addr = static_cast<char *>(addr);
+            seg.size = size;
+            seg.filename = filename;
+            return seg;
+        }
+
+        static void DiscardSegment(const Segment &seg)
+        {
+            if (seg.addr == nullptr) return;
+            munmap(seg.addr, seg.size);
+            close(seg.fd);
+            unlink(seg.filename.c_str());
+        }
+
+        // 同步剩余数据，解除映射并截掉没写到的尾部
+        void CloseSegment()
+        {
+            if (cur_.addr == nullptr) return;
+            sync_.Detach();
+            munmap(cur_.addr, cur_.size);
+            if (ftruncate(cur_.fd, used_) != 0) {
+                std::cout << __FILE__ << __LINE__ << "truncate file failed" << std::endl;
+                perror(NULL);
+            }
+            close(cur_.fd);
+            archiver_.Submit(cur_.filename);
+            cur_ = Segment();
+            used_ = 0;
+        }
+
+        // 换到下一个分段，并在后台开始准备再下一个；单批超过分段大小时单独建一个放得下的分段
+        void Roll(size_t len)
+        {
+            CloseSegment();
+            std::string preamble;
+            if (preamble_) preamble_(&preamble);
+            len += preamble.size();
+            if (next_.valid()) {
+                Segment next = next_.get();
+                if (next.size >= len) {
+                    cur_ = next;
+                } else {
+                    DiscardSegment(next);
+                }
+            }
+            if (cur_.addr == nullptr) {
+                cur_ = CreateSegment(CreateFilename(), std::max(segment_size_, len));
+                if (cur_.addr == nullptr) return;
+            }
+            sync_.Attach(cur_.fd);
+            memcpy(cur_.addr, preamble.data(), preamble.size());
+            used_ = preamble.size();
+            next_ = std::async(std::launch::async, &MmapFileFlush::CreateSegment, CreateFilename(), segment_size_);
+        }
+
+        // 命名方式和 RollFileFlush 一致
+        std::string CreateFilename()
+        {
+            time_t time_ = Util::Date::Now();
+            struct tm t;
+            localtime_r(&time_, &t);
+            std::string filename = basename_;
+            filename += std::to_string(t.tm_year + 1900);
+            filename += std::to_string(t.tm_mon + 1);
+            filename += std::to_string(t.tm_mday);
+            filename += std::to_string(t.tm_hour + 1);
+            filename += std::to_string(t.tm_min + 1);
+            filename += std::to_string(t.tm_sec + 1) + '-' +
+                        std::to_string(cnt_++) + ".log";
+            return filename;
+        }
+
+    private:
+        size_t cnt_ = 1;
+        size_t segment_size_;
+        std::string basename_;
+        Segment cur_;
+        size_t used_ = 0;             // 当前分段已写入的字节数
+        std::future<Segment> next_;   // 后台预建的下一个分段
+        GroupSync sync_;
+        LogArchiver archiver_;
     };
 
     class LogFlushFactory
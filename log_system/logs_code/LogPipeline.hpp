@@ -6,38 +6,117 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
-#include <map>
 #include <functional>
-#include <queue>
+#include <deque>
+#include <algorithm>
 #include <memory>
 #include <chrono>
+#include <cstdio>
+#include <limits>
 
 #include "AsyncBuffer.hpp"
+#include "Formatter.hpp"
+#include "MpscQueue.hpp"
+#include "Sampling.hpp"
 #include "LogFlush.hpp"
+#include "SinkWriter.hpp"
 #include "Util.hpp"
-#include"ThreadPoll.hpp"
-#include "backlog/CliBackupLog.hpp"
+#include "backlog/BackupClient.hpp"
 extern mylog::Util::JsonData* g_conf_data;
 
 namespace mylog {
 
+// 积压的日志超过上限时怎么处理新日志
+enum class OverflowPolicy {
+    BLOCK,        // 生产者等待，直到积压降到上限以下，不丢日志
+    DROP_NEWEST,  // 丢弃新来的日志
+    DROP_BELOW,   // 丢弃 WARN 以下的日志，WARN 及以上在两倍上限内照常接收
+    SAMPLE        // 按比例抽样保留，同样不超过两倍上限
+};
+
+inline const char* OverflowPolicyName(OverflowPolicy policy) {
+    switch (policy) {
+        case OverflowPolicy::BLOCK: return "block";
+        case OverflowPolicy::DROP_NEWEST: return "drop_newest";
+        case OverflowPolicy::DROP_BELOW: return "drop_below";
+        case OverflowPolicy::SAMPLE: return "sample";
+    }
+    return "unknown";
+}
+
+// 配置文件中的 overflow_policy，无法识别时按 block 处理
+inline OverflowPolicy OverflowPolicyFromString(const std::string& name) {
+    if (name == "drop_newest") return OverflowPolicy::DROP_NEWEST;
+    if (name == "drop_below") return OverflowPolicy::DROP_BELOW;
+    if (name == "sample") return OverflowPolicy::SAMPLE;
+    return OverflowPolicy::BLOCK;
+}
+
+// 一批待格式化的日志，由任务队列和正在处理它的各格式化线程共同持有
+// 大批次被切成若干段，空闲的格式化线程通过共享的游标领取下一段，一起处理
 struct LogBatchTask {
     std::unique_ptr<Buffer> buffer;
+    size_t chunk_size;               // 每次领取的条数
+    std::atomic<size_t> cursor{0};   // 下一段未被领取的起始下标
+    BufferPool* pool;                // 最后一个持有者放手时，批次连同其中的记录一起回收
     
-    LogBatchTask(std::unique_ptr<Buffer> buf) : buffer(std::move(buf)) {}
+    LogBatchTask(std::unique_ptr<Buffer> buf, size_t chunk, BufferPool* p)
+        : buffer(std::move(buf)), chunk_size(chunk), pool(p) {}
+    ~LogBatchTask() {
+        pool->Release(std::move(buffer));
+    }
     LogBatchTask(const LogBatchTask&) = delete;
     LogBatchTask& operator=(const LogBatchTask&) = delete;
-    LogBatchTask(LogBatchTask&&) = default;
-    LogBatchTask& operator=(LogBatchTask&&) = default;
+
+    // 所有段都已被领取(不代表已处理完)
+    bool Exhausted() const {
+        return cursor.load(std::memory_order_relaxed) >= buffer->Size();
+    }
 };
 
 class LogPipeline {
 public:
-    LogPipeline(const std::vector<LogFlush::ptr>& flushers)
-        : flushers_(flushers),
-          stop_flag_(false),
-          producer_buffer_(std::make_unique<Buffer>())
+    LogPipeline(const std::vector<LogFlush::ptr>& flushers, const std::string& logger_name = "", bool binary = false)
+        : stop_flag_(false),
+          formatter_(g_conf_data != nullptr && !g_conf_data->pattern.empty() ? g_conf_data->pattern
+                                                                            : Formatter::kDefaultPattern,
+                     StructuredFormatFromString(g_conf_data != nullptr ? g_conf_data->structured_format : "")),
+          ring_(kRingCapacity),
+          reorder_slots_(new ReorderSlot[kReorderCapacity]),
+          flushers_(flushers),
+          logger_name_(logger_name),
+          binary_(binary)
     {
+        for (size_t i = 0; i < kReorderCapacity; ++i) {
+            reorder_slots_[i].state.store(static_cast<uint64_t>(i) << 2 | kSlotEmpty, std::memory_order_relaxed);
+        }
+        if (g_conf_data != nullptr) {
+            // buffer_size 为 0 表示不限制积压
+            if (g_conf_data->buffer_size > 0) {
+                pending_limit_ = g_conf_data->buffer_size;
+            }
+            overflow_policy_.store(OverflowPolicyFromString(g_conf_data->overflow_policy), std::memory_order_relaxed);
+            if (g_conf_data->overflow_sample_rate > 0) {
+                sample_rate_ = g_conf_data->overflow_sample_rate;
+            }
+        }
+        size_t sink_queue_bytes = kDefaultSinkQueueBytes;
+        SinkWriter::Overflow sink_overflow = SinkWriter::Overflow::BLOCK;
+        if (g_conf_data != nullptr) {
+            if (g_conf_data->sink_queue_bytes > 0) sink_queue_bytes = g_conf_data->sink_queue_bytes;
+            sink_overflow = SinkWriter::OverflowFromString(g_conf_data->sink_overflow);
+        }
+        for (const auto& flusher : flushers_) {
+            if (binary_) {
+                // 滚动出的每个分段都带上文件头和调用点表，单独拿出来(或前面的分段被清理后)也能解码
+                std::string name = logger_name_;
+                flusher->SetSegmentPreamble([name](std::string* out) { BinaryFrame::AppendPreamble(name, out); });
+            }
+            sink_writers_.emplace_back(new SinkWriter(flusher, sink_queue_bytes, sink_overflow));
+        }
+        if (g_conf_data != nullptr && g_conf_data->backup_enable) {
+            backup_client_ = BackupClient::Shared();
+        }
         size_t formatter_count = 0;
         if (g_conf_data != nullptr && g_conf_data->thread_count > 0) {
             formatter_count = g_conf_data->thread_count;
@@ -47,6 +126,7 @@ public:
         }
         
         formatter_threads_active_ = formatter_count;
+        formatter_count_ = formatter_count;
 
         for (size_t i = 0; i < formatter_count; ++i) {
             formatter_threads_.emplace_back(&LogPipeline::FormatterThreadEntry, this);
@@ -59,136 +139,559 @@ public:
         Stop();
     }
 
-    void Push(std::unique_ptr<LogMessage>&& msg) {
+    // 生产者入口：先追加到本线程的暂存缓冲区，攒够一批再整批写入环形队列
+    // 平时只碰本线程独占的缓存行，共享的队列位置每批才写一次
+    // 积压超过上限时按溢出策略处理，没超过时只多一次共享变量的读
+    void Push(MessagePtr&& msg) {
         if (stop_flag_.load(std::memory_order_acquire)) return;
+        if (pending_bytes_.load(std::memory_order_relaxed) >= pending_limit_ && !AdmitOverflow(*msg)) return;
+        StagingBuffer* staging = LocalStaging();
+        bool first = false;
         {
-            std::unique_lock<std::mutex> lock(mtx_producer_);
-            producer_buffer_->Push(std::move(msg));
+            // 这把锁只会和主循环的定时清扫竞争，绝大多数时候无竞争
+            std::lock_guard<std::mutex> lock(staging->mtx);
+            first = staging->buffer->IsEmpty();
+            staging->buffer->Push(std::move(msg));
+            if (staging->buffer->Size() >= kStagingBatchSize) {
+                // 持锁发布，保证清扫取走的后续日志不会排到这一批前面
+                PublishBatch(std::move(staging->buffer));
+                staging->buffer = buffer_pool_.Acquire();
+                return;
+            }
         }
-        cond_main_loop_.notify_one();
+        if (first) {
+            // 暂存区由空变为非空：主循环若已睡下，叫醒它按时清扫，避免零星日志等太久
+            staging_dirty_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (main_loop_parked_.load(std::memory_order_relaxed)) {
+                WakeMainLoop();
+            }
+        }
+    }
+
+    void SetOverflowPolicy(OverflowPolicy policy) {
+        overflow_policy_.store(policy, std::memory_order_relaxed);
+    }
+
+    // 因积压过多被丢弃的日志总数
+    uint64_t DroppedCount() const {
+        return dropped_total_.load(std::memory_order_relaxed);
+    }
+
+    // 调用点第一次拦下日志时登记，之后主循环每个汇报周期写一条它被拦下的条数
+    void TrackSampledSite(SampledSite* site) {
+        std::lock_guard<std::mutex> lock(mtx_sites_);
+        sampled_sites_.push_back(site);
+    }
+
+    // 每个落地器一行：写入量、排队的字节数、滞后和丢弃量
+    std::string SinkReport() const {
+        std::string report;
+        for (size_t i = 0; i < sink_writers_.size(); ++i) {
+            report += "sink " + std::to_string(i) + ": " + sink_writers_[i]->Report() + "\n";
+        }
+        return report;
     }
 
 private:
-    void MainLoopThreadEntry() {
-        while (!stop_flag_.load(std::memory_order_relaxed)) {
-            std::unique_ptr<Buffer> buffer_to_process;
-            {
-                std::unique_lock<std::mutex> lock(mtx_producer_);
-                // 使用 wait 即时响应
-                cond_main_loop_.wait(lock, [this] {
-                    return stop_flag_.load(std::memory_order_relaxed) || !producer_buffer_->IsEmpty();
-                });
+    static constexpr size_t kRingCapacity = 1 << 12;   // 单位是批
+    static constexpr size_t kStagingBatchSize = 64;    // 暂存区攒够这么多条就整批发布
+    static constexpr std::chrono::milliseconds kStagingFlushInterval{1}; // 主循环清扫暂存区的周期
+    static constexpr int kSpinBeforePark = 64;
+    static constexpr size_t kMinFormatChunk = 256; // 格式化线程每次领取的最少条数，太小了游标争用得不偿失
+    static constexpr size_t kReorderCapacity = 1 << 14; // 重排环槽位数，必须是2的幂
+    static constexpr size_t kSlotReserve = 256;         // 槽位字符串首次使用时预留的容量
+    static constexpr std::chrono::milliseconds kMissingSeqTimeout{1000}; // 缺失序号最多等这么久
+    static constexpr std::chrono::milliseconds kDropReportInterval{1000}; // 丢弃统计写进日志的周期
+    static constexpr size_t kDefaultSinkQueueBytes = 64 * 1024 * 1024;   // 每个落地器最多排队的字节数
+    static constexpr size_t kBatchReserve = 4 * 1024;                    // 新建批次字符串预留的容量
+    static constexpr size_t kMaxSpareBatches = 64;
+
+    enum : uint64_t { kSlotEmpty = 0, kSlotWriting = 1, kSlotReady = 2 };
+
+    // 重排环的槽位，按缓存行对齐，避免相邻序号被不同格式化线程写时伪共享
+    struct alignas(64) ReorderSlot {
+        std::atomic<uint64_t> state{0};
+        std::string line;
+        bool backup = false;     // ERROR 及以上，IO线程按序写出时顺带交给备份客户端
+        std::string backup_line; // 二进制模式下备份用的文本行，文本模式直接用 line
+    };
+
+    // 一个生产者线程在一条流水线上的暂存区
+    // 由线程局部的 StagingCache 和流水线的登记表共同持有
+    struct StagingBuffer {
+        std::mutex mtx;
+        std::unique_ptr<Buffer> buffer = std::make_unique<Buffer>();
+        bool orphaned = false; // 所属线程已退出，清扫后即可从登记表移除
+    };
+
+    // 每个线程一份，记录该线程在各条流水线上的暂存区
+    // 线程退出时把暂存区标记为孤儿，剩余日志由主循环下一次清扫发布
+    struct StagingCache {
+        std::vector<std::pair<uint64_t, std::shared_ptr<StagingBuffer>>> entries;
+        ~StagingCache() {
+            for (auto& e : entries) {
+                std::lock_guard<std::mutex> lock(e.second->mtx);
+                e.second->orphaned = true;
+            }
+        }
+    };
 
-                if (stop_flag_.load(std::memory_order_relaxed)) {
-                     // 在退出前，捕获最后一批日志
-                    if (!producer_buffer_->IsEmpty()) {
-                        buffer_to_process = std::move(producer_buffer_);
+    static uint64_t NextPipelineId() {
+        static std::atomic<uint64_t> next_id{0};
+        return next_id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    StagingBuffer* LocalStaging() {
+        // 用流水线id而不是地址做键，流水线销毁后地址被复用也不会串
+        thread_local StagingCache cache;
+        for (auto& e : cache.entries) {
+            if (e.first == id_) return e.second.get();
+        }
+        auto staging = std::make_shared<StagingBuffer>();
+        {
+            std::lock_guard<std::mutex> lock(mtx_staging_);
+            stagings_.push_back(staging);
+        }
+        cache.entries.emplace_back(id_, staging);
+        return staging.get();
+    }
+
+    // 积压已超过上限，决定这条日志是否接收，不接收的计入丢弃统计
+    bool AdmitOverflow(const LogMessage& msg) {
+        const size_t hard_limit = pending_limit_ > kUnlimited / 2 ? kUnlimited : pending_limit_ * 2;
+        switch (overflow_policy_.load(std::memory_order_relaxed)) {
+            case OverflowPolicy::BLOCK:
+                // 等格式化线程消化积压；停止时不再等待，日志丢弃
+                for (int spins = 0; pending_bytes_.load(std::memory_order_relaxed) >= pending_limit_; ++spins) {
+                    if (stop_flag_.load(std::memory_order_acquire)) return false;
+                    if (spins < kSpinBeforePark) {
+                        std::this_thread::yield();
+                    } else {
+                        std::this_thread::sleep_for(std::chrono::microseconds(200));
                     }
-                } else if (!producer_buffer_->IsEmpty()) {
-                    buffer_to_process = std::move(producer_buffer_);
-                    producer_buffer_ = std::make_unique<Buffer>(); // 为生产者创建新缓冲区
                 }
+                return true;
+            case OverflowPolicy::DROP_NEWEST:
+                break;
+            case OverflowPolicy::DROP_BELOW:
+                if (msg.level_ >= LogLevel::value::WARN &&
+                    pending_bytes_.load(std::memory_order_relaxed) < hard_limit) return true;
+                break;
+            case OverflowPolicy::SAMPLE:
+                if (pending_bytes_.load(std::memory_order_relaxed) < hard_limit &&
+                    sample_counter_.fetch_add(1, std::memory_order_relaxed) % sample_rate_ == 0) return true;
+                break;
+        }
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        dropped_total_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // 上一个周期有日志被丢弃时，在批次里追加一条 WARN 记录说明丢了多少
+    void ReportDropped(Buffer& out) {
+        uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+        if (dropped == 0) return;
+        char text[256];
+        int len = snprintf(text, sizeof(text),
+                           "mylog: dropped %llu log messages because of backlog or a stalled formatter "
+                           "(policy %s, limit %zu bytes, %llu dropped in total)",
+                           static_cast<unsigned long long>(dropped),
+                           OverflowPolicyName(overflow_policy_.load(std::memory_order_relaxed)), pending_limit_,
+                           static_cast<unsigned long long>(dropped_total_.load(std::memory_order_relaxed)));
+        MessagePtr msg = MessagePool::Acquire();
+        msg->Init(LogLevel::value::WARN, __FILE__, __LINE__, logger_name_.c_str());
+        msg->SetPayload(text, std::min<size_t>(len, sizeof(text) - 1));
+        pending_bytes_.fetch_add(msg->Footprint(), std::memory_order_relaxed);
+        out.Push(std::move(msg));
+    }
+
+    // 上一个周期有被采样或限流拦下的日志时，按原调用点的等级、文件名和行号追加一条说明
+    void ReportSuppressed(Buffer& out) {
+        std::lock_guard<std::mutex> lock(mtx_sites_);
+        for (SampledSite* site : sampled_sites_) {
+            uint64_t suppressed = site->TakeSuppressed();
+            if (suppressed == 0) continue;
+            char mode[64], text[160];
+            site->Describe(mode, sizeof(mode));
+            int len = snprintf(text, sizeof(text), "mylog: suppressed %llu messages from this call site (%s)",
+                               static_cast<unsigned long long>(suppressed), mode);
+            MessagePtr msg = MessagePool::Acquire();
+            msg->Init(site->Level(), site->File(), site->Line(), logger_name_.c_str());
+            msg->SetPayload(text, std::min<size_t>(len, sizeof(text) - 1));
+            pending_bytes_.fetch_add(msg->Footprint(), std::memory_order_relaxed);
+            out.Push(std::move(msg));
+        }
+    }
+
+    void PublishBatch(std::unique_ptr<Buffer>&& batch) {
+        // 整批计入积压，必须在入队之前：入队后格式化线程随时可能处理完并减掉，先减后加会让计数下溢
+        // 发布失败(停止)时这批日志会随 batch 一起回收，把计入的再减回去
+        const size_t bytes = batch->Bytes();
+        pending_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        while (!ring_.TryPush(std::move(batch))) {
+            // 队列满说明主循环跟不上，确保它醒着，然后让出CPU等它腾出槽位
+            if (stop_flag_.load(std::memory_order_acquire)) {
+                pending_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+                return;
+            }
+            WakeMainLoop();
+            std::this_thread::yield();
+        }
+        // 和 ParkMainLoop 中的栅栏配对：要么这里看到 parked，要么主循环看到新数据
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (main_loop_parked_.load(std::memory_order_relaxed)) {
+            WakeMainLoop();
+        }
+    }
+
+    // 把各线程暂存区里未满的批次收进 out，顺带移除已退出线程的空暂存区
+    // 生产者持暂存区的锁发布整批，所以持锁时队列里该线程的批次都比暂存区里的旧：先取空队列再追加
+    // 生产者可能持锁等队列腾位置，平时只 try_lock，抢不到的下次再扫；停止时生产者会放弃等待，可以阻塞加锁
+    void SweepStaging(Buffer& out, bool wait) {
+        staging_dirty_.store(false, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> registry_lock(mtx_staging_);
+        for (size_t i = 0; i < stagings_.size();) {
+            StagingBuffer& staging = *stagings_[i];
+            std::unique_lock<std::mutex> lock(staging.mtx, std::defer_lock);
+            if (wait) {
+                lock.lock();
+            } else if (!lock.try_lock()) {
+                staging_dirty_.store(true, std::memory_order_relaxed);
+                ++i;
+                continue;
             }
+            if (!staging.buffer->IsEmpty()) {
+                DrainRing(out);
+                pending_bytes_.fetch_add(staging.buffer->Bytes(), std::memory_order_relaxed);
+                out.Append(*staging.buffer);
+            }
+            bool remove = staging.orphaned;
+            lock.unlock();
+            if (remove) {
+                stagings_[i] = std::move(stagings_.back());
+                stagings_.pop_back();
+            } else {
+                ++i;
+            }
+        }
+    }
 
-            if (buffer_to_process) {
+    void DrainRing(Buffer& out) {
+        std::unique_ptr<Buffer> batch;
+        while (ring_.TryPop(batch)) {
+            out.Append(*batch);
+            buffer_pool_.Release(std::move(batch));
+        }
+    }
+
+    void WakeMainLoop() {
+        // 加锁再通知，避免主循环检查完队列、还没进入 wait 时丢失唤醒
+        { std::lock_guard<std::mutex> lock(mtx_main_loop_); }
+        cond_main_loop_.notify_one();
+    }
+
+    // 暂存区里还有日志时最多睡到下一次清扫，否则睡到有整批发布或暂存区变为非空
+    void ParkMainLoop(std::chrono::steady_clock::time_point next_sweep) {
+        for (int i = 0; i < kSpinBeforePark; ++i) {
+            if (!ring_.Empty() || stop_flag_.load(std::memory_order_relaxed)) return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mtx_main_loop_);
+        main_loop_parked_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (staging_dirty_.load(std::memory_order_relaxed)) {
+            cond_main_loop_.wait_until(lock, next_sweep, [this] {
+                return stop_flag_.load(std::memory_order_relaxed) || !ring_.Empty();
+            });
+        } else {
+            cond_main_loop_.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return stop_flag_.load(std::memory_order_relaxed) || !ring_.Empty() ||
+                       staging_dirty_.load(std::memory_order_relaxed);
+            });
+        }
+        main_loop_parked_.store(false, std::memory_order_relaxed);
+    }
+
+    void MainLoopThreadEntry() {
+        auto next_sweep = std::chrono::steady_clock::now();
+        auto next_drop_report = next_sweep + kDropReportInterval;
+        std::unique_ptr<Buffer> buffer_to_process = buffer_pool_.Acquire();
+        while (true) {
+            // 收集已发布的整批，到点了再把各线程未满的暂存区扫进来，组成一个批次
+            DrainRing(*buffer_to_process);
+            auto now = std::chrono::steady_clock::now();
+            bool stopping = stop_flag_.load(std::memory_order_acquire);
+            if (now >= next_sweep || stopping) {
+                SweepStaging(*buffer_to_process, stopping);
+                next_sweep = now + kStagingFlushInterval;
+            }
+            if (now >= next_drop_report || stopping) {
+                ReportDropped(*buffer_to_process);
+                ReportSuppressed(*buffer_to_process);
+                next_drop_report = now + kDropReportInterval;
+            }
+
+            if (!buffer_to_process->IsEmpty()) {
+                // 序号按主循环收到的顺序分配，同一线程的日志在批内保持原有顺序
+                for (size_t i = 0; i < buffer_to_process->Size(); ++i) {
+                    buffer_to_process->Mutable(i).sequence_id_ = next_seq_to_assign_++;
+                }
+                seq_assigned_.store(next_seq_to_assign_, std::memory_order_release);
+                // 按格式化线程数切段，每个线程大约能分到几段，但每段不少于 kMinFormatChunk 条
+                size_t batch_size = buffer_to_process->Size();
+                size_t chunk = std::max(kMinFormatChunk, (batch_size + formatter_count_ * 4 - 1) / (formatter_count_ * 4));
                 std::unique_lock<std::mutex> lock(mtx_task_queue_);
-                task_queue_.emplace(std::move(buffer_to_process));
-                cond_task_queue_.notify_one();
+                task_queue_.push_back(std::make_shared<LogBatchTask>(std::move(buffer_to_process), chunk, &buffer_pool_));
+                if (batch_size > chunk) {
+                    cond_task_queue_.notify_all(); // 不止一段，叫醒空闲的线程一起做
+                } else {
+                    cond_task_queue_.notify_one();
+                }
+                lock.unlock();
+                buffer_to_process = buffer_pool_.Acquire();
+                continue;
             }
+            // 停止后把环形队列和暂存区都取空再退出
+            if (stopping) break;
+            ParkMainLoop(next_sweep);
         }
+        // 格式化线程要等到这里才能退出，否则最后一批可能没人处理
+        std::lock_guard<std::mutex> lock(mtx_task_queue_);
+        main_loop_done_ = true;
+        cond_task_queue_.notify_all();
     }
 
     void FormatterThreadEntry() {
         while (true) {
-            std::unique_ptr<LogBatchTask> current_task_ptr;
+            std::shared_ptr<LogBatchTask> task;
             {
                 std::unique_lock<std::mutex> lock(mtx_task_queue_);
                 cond_task_queue_.wait(lock, [this]{
-                    return stop_flag_.load(std::memory_order_relaxed) || !task_queue_.empty();
+                    return main_loop_done_ || !task_queue_.empty();
                 });
-
-                if (stop_flag_.load(std::memory_order_relaxed) && task_queue_.empty()) {
-                    break; // 退出条件看看
+                // 已经被领完的任务出队，剩下的段还在别的线程手里，由它们持有的引用保证批次存活
+                while (!task_queue_.empty() && task_queue_.front()->Exhausted()) {
+                    task_queue_.pop_front();
                 }
-                
-                // 一次取一个
-                current_task_ptr = std::make_unique<LogBatchTask>(std::move(task_queue_.front()));
-                task_queue_.pop();
+                if (task_queue_.empty()) {
+                    if (main_loop_done_) break; // 主循环已退出且没有剩余任务
+                    continue;
+                }
+                task = task_queue_.front();
             }
 
-            // 锁外处理任务，得看看安全不安全
-            std::atomic<size_t> task_consume_idx(0);
-            size_t task_size = current_task_ptr->buffer->Size();
-
+            // 锁外通过共享游标一段一段地领取，直到这一批被领完
+            const Buffer& batch = *task->buffer;
+            size_t task_size = batch.Size();
             while (true) {
-                size_t idx = task_consume_idx.fetch_add(1, std::memory_order_relaxed);
-                if (idx >= task_size) break;
-                
-                const auto& msg_ptr = current_task_ptr->buffer->at(idx);
-
-                if (msg_ptr->level_ >= LogLevel::value::ERROR)
-                {
-                    if (backup_thread_pool_) {
-                        try {
-                            // 格式化日志并提交给内部的备份线程池
-                            std::string data_for_backup = msg_ptr->format();
-                            backup_thread_pool_->enqueue(start_backup, data_for_backup);
-                        } catch (const std::runtime_error&) {}
-                    }
+                size_t begin = task->cursor.fetch_add(task->chunk_size, std::memory_order_relaxed);
+                if (begin >= task_size) break;
+                size_t end = std::min(begin + task->chunk_size, task_size);
+                size_t bytes = 0;
+                for (size_t idx = begin; idx < end; ++idx) {
+                    bytes += batch.at(idx)->Footprint();
+                    PublishLine(*batch.at(idx));
                 }
+                // 格式化完的行进了容量固定的重排环，记录所在的批次很快会被回收，不再算作积压
+                pending_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+                NotifyIO(); // 每段通知一次IO线程
+            }
+        }
+        formatter_threads_active_.fetch_sub(1, std::memory_order_release); // 线程确认退出前，才递减计数
+        NotifyIO();
+    }
 
+    // 把一条日志直接格式化进它序号对应的重排环槽位，不加锁
+    // 槽位 state 的高位是当前轮到的序号，低两位是阶段：空 -> 写入中 -> 就绪
+    void PublishLine(const LogMessage& msg) {
+        const uint64_t seq = msg.sequence_id_;
+        ReorderSlot& slot = reorder_slots_[seq & (kReorderCapacity - 1)];
+        const uint64_t empty = seq << 2 | kSlotEmpty;
+        while (true) {
+            uint64_t cur = slot.state.load(std::memory_order_acquire);
+            if (cur == empty) {
+                if (slot.state.compare_exchange_weak(cur, seq << 2 | kSlotWriting, std::memory_order_acquire)) break;
+                continue;
+            }
+            if ((cur >> 2) > seq) {
+                return; // IO线程等不及已经跳过了这个序号，迟到的这一行丢弃
+            }
+            // 槽位还被 seq - N 占着，IO线程落后了一整圈，等它腾出来
+            NotifyIO();
+            std::this_thread::yield();
+        }
+        // 槽位里的字符串保留着上一圈的容量，格式化时通常不需要再分配
+        // 第一圈先预留一行的典型长度，免得从空串开始逐次翻倍
+        try {
+            if (slot.line.capacity() < kSlotReserve) {
+                slot.line.reserve(kSlotReserve);
+            }
+            if (binary_) {
+                BinaryFrame::AppendMessage(msg, &slot.line);
+            } else {
+                formatter_.Format(msg, &slot.line);
+            }
+            slot.backup = backup_client_ != nullptr && msg.level_ >= LogLevel::value::ERROR;
+            if (slot.backup && binary_) {
+                formatter_.Format(msg, &slot.backup_line); // 接收端收的是文本行
+            }
+        } catch (const std::exception&) {
+            slot.line.clear(); // 写入中的槽位不能被跳过，出错也要发布，只是内容为空
+            slot.backup_line.clear();
+            slot.backup = false;
+        }
+        slot.state.store(seq << 2 | kSlotReady, std::memory_order_release);
+    }
 
+    void NotifyIO() {
+        // 和 ParkIO 中的栅栏配对：要么这里看到 parked，要么IO线程看到已就绪的槽位
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (io_parked_.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> lock(mtx_io_); }
+            cond_io_.notify_one();
+        }
+    }
 
+    bool SlotReady(uint64_t seq) const {
+        return reorder_slots_[seq & (kReorderCapacity - 1)].state.load(std::memory_order_acquire) ==
+               (seq << 2 | kSlotReady);
+    }
 
-                std::string formatted_str = msg_ptr->format();
+    // 跳过迟迟没有到达的序号，正在写入的槽位不能跳过；跳过的记录计入丢弃统计，由主循环汇报
+    bool TrySkip(uint64_t seq) {
+        ReorderSlot& slot = reorder_slots_[seq & (kReorderCapacity - 1)];
+        uint64_t expected = seq << 2 | kSlotEmpty;
+        if (!slot.state.compare_exchange_strong(expected, (seq + kReorderCapacity) << 2 | kSlotEmpty,
+                                                std::memory_order_acq_rel)) {
+            return false;
+        }
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        dropped_total_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
 
-                {
-                    std::unique_lock<std::mutex> lock(mtx_reorder_);
-                    reorder_buffer_[msg_ptr->sequence_id_] = std::move(formatted_str);
-                } 
-                cond_io_.notify_one(); // 总是通知IO线程
+    void ParkIO(uint64_t next, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mtx_io_);
+        io_parked_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cond_io_.wait_for(lock, timeout, [this, next] {
+            return SlotReady(next) || formatter_threads_active_.load(std::memory_order_relaxed) == 0;
+        });
+        io_parked_.store(false, std::memory_order_relaxed);
+    }
+
+    // 取一个空的批次字符串，优先复用写线程用完还回来的
+    std::unique_ptr<std::string> TakeSpareBatch() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_spare_);
+            if (!spare_batches_.empty()) {
+                std::unique_ptr<std::string> batch = std::move(spare_batches_.back());
+                spare_batches_.pop_back();
+                return batch;
             }
         }
-        formatter_threads_active_--; // 线程确认退出前，才递减计数
-        cond_io_.notify_one();
+        std::unique_ptr<std::string> batch(new std::string);
+        batch->reserve(kBatchReserve);
+        return batch;
     }
 
-    void IOThreadEntry() {
-        std::string batch_buffer;
-        batch_buffer.reserve(4 * 1024);
+    // 交给各落地器共享，最后一个写完的写线程把字符串还回来，容量保留
+    LogBatch ShareBatch(std::unique_ptr<std::string>&& batch) {
+        return LogBatch(batch.release(), [this](const std::string* data) {
+            std::unique_ptr<std::string> spare(const_cast<std::string*>(data));
+            spare->clear();
+            std::lock_guard<std::mutex> lock(mtx_spare_);
+            if (spare_batches_.size() < kMaxSpareBatches) {
+                spare_batches_.push_back(std::move(spare));
+            }
+        });
+    }
 
-        while (true) {
-            {
-                std::unique_lock<std::mutex> lock(mtx_reorder_);
-                // 超时机制
-                cond_io_.wait_for(lock, std::chrono::milliseconds(100), [this] {
-                    return (formatter_threads_active_.load(std::memory_order_relaxed) == 0 && reorder_buffer_.empty()) ||
-                           reorder_buffer_.count(next_seq_to_write_);
-                });
+    // 二进制模式下，在记录之前写出文件头和新登记的调用点，只在IO线程调用
+    // 批次里的记录引用的调用点在入队前就已登记，这里读到的登记数一定覆盖它们
+    void WriteBinaryPreamble() {
+        std::unique_ptr<std::string> preamble = TakeSpareBatch();
+        if (!header_written_) {
+            BinaryFrame::AppendHeader(logger_name_, preamble.get());
+            header_written_ = true;
+        }
+        uint32_t count = BinarySites::Count();
+        for (; sites_written_ < count; ++sites_written_) {
+            const BinarySite* site = BinarySites::Get(sites_written_);
+            if (site != nullptr) {
+                BinaryFrame::AppendSite(sites_written_, *site, preamble.get());
+            }
+        }
+        if (preamble->empty()) return;
+        // 后面的记录要靠它解码，落地器落后时也不能丢
+        LogBatch batch = ShareBatch(std::move(preamble));
+        for (auto& writer : sink_writers_) {
+            writer->Enqueue(batch, false);
+        }
+    }
 
-                if (formatter_threads_active_.load(std::memory_order_relaxed) == 0 && reorder_buffer_.empty()) {
-                    break; 
-                }
+    void IOThreadEntry() {
+        std::unique_ptr<std::string> batch_buffer = TakeSpareBatch();
+        uint64_t next_seq_to_write = 0;
+        bool waiting = false; // 正在等一个已分配但还没就绪的序号
+        auto waiting_since = std::chrono::steady_clock::now();
 
-                while (reorder_buffer_.count(next_seq_to_write_)) {
-                    batch_buffer.append(reorder_buffer_.at(next_seq_to_write_));
-                    reorder_buffer_.erase(next_seq_to_write_);
-                    next_seq_to_write_++;
+        while (true) {
+            // 按序号顺序取出连续就绪的行，每行只是一次状态检查加一次追加
+            while (SlotReady(next_seq_to_write)) {
+                ReorderSlot& slot = reorder_slots_[next_seq_to_write & (kReorderCapacity - 1)];
+                batch_buffer->append(slot.line);
+                if (slot.backup) {
+                    // 在这里按序号顺序交给备份客户端，远端收到的顺序和本地文件一致
+                    slot.backup = false;
+                    if (binary_) {
+                        backup_client_->Enqueue(std::move(slot.backup_line));
+                        slot.backup_line.clear();
+                    } else if (!slot.line.empty()) {
+                        backup_client_->Enqueue(slot.line);
+                    }
                 }
+                slot.line.clear(); // 保留容量给下一圈复用
+                slot.state.store((next_seq_to_write + kReorderCapacity) << 2 | kSlotEmpty,
+                                 std::memory_order_release);
+                ++next_seq_to_write;
             }
             
-            if (!batch_buffer.empty()) {
-                // 错误处理
-                for (const auto& flusher : flushers_) {
-                    try {
-                        flusher->Flush(batch_buffer.c_str(), batch_buffer.size());
-                    } catch (const std::exception& e) {
-                        // 这个后面得再看一看，可能要改
-                        // fprintf(stderr, "Log flush error: %s\n", e.what());
-                    }
+            if (!batch_buffer->empty()) {
+                waiting = false;
+                if (binary_) {
+                    WriteBinaryPreamble();
+                }
+                // 交给各落地器的写线程，慢的落地器只会拖住自己的队列
+                LogBatch batch = ShareBatch(std::move(batch_buffer));
+                for (auto& writer : sink_writers_) {
+                    writer->Enqueue(batch);
                 }
-                batch_buffer.clear();
+                batch_buffer = TakeSpareBatch();
+                continue;
+            }
+
+            // 格式化线程退出前会看到主循环结束，此时 seq_assigned_ 已是最终值
+            bool formatters_done = formatter_threads_active_.load(std::memory_order_acquire) == 0;
+            uint64_t assigned = seq_assigned_.load(std::memory_order_acquire);
+            if (next_seq_to_write >= assigned) {
+                if (formatters_done) break;
+                ParkIO(next_seq_to_write, std::chrono::milliseconds(100));
+                continue;
+            }
+            // 已分配的序号还没就绪：格式化线程都退出了说明它丢了，否则等到超时再跳过
+            auto now = std::chrono::steady_clock::now();
+            if (!waiting) {
+                waiting = true;
+                waiting_since = now;
+            }
+            if ((formatters_done || now - waiting_since >= kMissingSeqTimeout) && TrySkip(next_seq_to_write)) {
+                ++next_seq_to_write;
+                waiting = false;
+                continue;
             }
+            ParkIO(next_seq_to_write, std::chrono::milliseconds(10));
         }
     }
 
@@ -198,14 +701,8 @@ private:
         }
         
         // 唤醒并等待主循环线程结束
-        cond_main_loop_.notify_all();
+        WakeMainLoop();
         main_loop_thread_.join();
-        if (backup_thread_pool_) {
-            // 析构函数需要等待任务完成
-            backup_thread_pool_.reset();
-        }
-
-
 
         // 唤醒所有格式化线程，处理完队列中的剩余任务
         cond_task_queue_.notify_all();
@@ -214,34 +711,69 @@ private:
         }
         
         // 相当于最后的收为工作
-        cond_io_.notify_all();
+        NotifyIO();
         io_thread_.join();
+
+        // 各落地器写完排队的批次
+        for (auto& writer : sink_writers_) {
+            writer->Stop();
+        }
     }
 
 private:
+    BufferPool buffer_pool_; // 要比任务队列、暂存区里的 Buffer 活得久，放在最前面
     std::atomic<bool> stop_flag_;
     std::atomic<size_t> formatter_threads_active_{0};
-    std::atomic<uint64_t> next_seq_to_write_{0};
-
-    std::unique_ptr<Buffer> producer_buffer_;
+    uint64_t next_seq_to_assign_ = 0; // 只有主循环线程使用
+    std::atomic<uint64_t> seq_assigned_{0}; // 已分配出去的序号个数，IO线程据此判断缺的序号是否真的存在
+    bool main_loop_done_ = false;           // 由 mtx_task_queue_ 保护
+
+    // 积压控制：已发布但还没格式化的日志记录占用的字节数，暂存区里未发布的不计
+    static constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+    std::atomic<size_t> pending_bytes_{0};
+    size_t pending_limit_ = kUnlimited;     // 取自配置 buffer_size
+    std::atomic<OverflowPolicy> overflow_policy_{OverflowPolicy::BLOCK};
+    size_t sample_rate_ = 10;               // SAMPLE 策略下每这么多条保留一条
+    std::atomic<uint64_t> sample_counter_{0};
+    std::atomic<uint64_t> dropped_{0};       // 上次写丢弃统计之后丢弃的条数
+    std::atomic<uint64_t> dropped_total_{0};
+    std::mutex mtx_sites_;
+    std::vector<SampledSite*> sampled_sites_; // 拦下过日志的调用点，都是静态对象
+
+    const uint64_t id_ = NextPipelineId();
+    const Formatter formatter_;
+    MpscQueue<std::unique_ptr<Buffer>> ring_; // 元素是生产者攒好的一批日志
+    std::atomic<bool> main_loop_parked_{false};
+    std::atomic<bool> staging_dirty_{false};  // 有暂存区在上次清扫后由空变为非空
+    std::mutex mtx_staging_;
+    std::vector<std::shared_ptr<StagingBuffer>> stagings_; // 各生产者线程暂存区的登记表
     
     std::thread main_loop_thread_;
     std::vector<std::thread> formatter_threads_;
     std::thread io_thread_;
 
-    std::mutex mtx_producer_;
+    std::mutex mtx_main_loop_;
     std::mutex mtx_task_queue_;
-    std::mutex mtx_reorder_;
+    std::mutex mtx_io_;
     std::condition_variable cond_main_loop_;
     std::condition_variable cond_task_queue_;
     std::condition_variable cond_io_;
     
-    std::queue<LogBatchTask> task_queue_;
-    std::map<uint64_t, std::string> reorder_buffer_;
+    std::deque<std::shared_ptr<LogBatchTask>> task_queue_;
+    size_t formatter_count_ = 1;
+    std::unique_ptr<ReorderSlot[]> reorder_slots_; // 按 序号 % kReorderCapacity 存放格式化好的行
+    std::atomic<bool> io_parked_{false};
 
     std::vector<LogFlush::ptr> flushers_;
-
-    std::unique_ptr<ThreadPool> backup_thread_pool_;
+    std::mutex mtx_spare_;
+    std::vector<std::unique_ptr<std::string>> spare_batches_; // 写完回收的批次字符串
+    std::vector<std::unique_ptr<SinkWriter>> sink_writers_; // 与 flushers_ 一一对应
+    std::string logger_name_;
+    const bool binary_;            // 落地二进制帧，见 BinaryLog.hpp
+    bool header_written_ = false;  // 以下两个只有IO线程使用
+    uint32_t sites_written_ = 1;   // 下一个要写出的调用点id
+
+    BackupClient* backup_client_ = nullptr; // 进程共享，backup_enable 关闭时为空
 
 };
 
@@ -1,8 +1,12 @@
+#include<atomic>
 #include<unordered_map>
+#include<vector>
 #include "AsyncLogger.hpp"
 
 namespace mylog{
     // 通过单例对象对日志器进行管理，懒汉模式
+    // 查找不加锁：日志器表是不可变的快照，添加日志器时复制一份新表再原子地发布，
+    // 旧表留到管理器析构时才释放，读线程拿到的指针一直有效。日志器只增不删，添加只发生在启动阶段
     class LoggerManager
     {
     public:
@@ -14,44 +18,84 @@ namespace mylog{
 
         bool LoggerExist(const std::string &name)
         {
-            std::unique_lock<std::mutex> lock(mtx_);
-            auto it = loggers_.find(name);
-            if (it == loggers_.end())
-                return false;
-            return true;
+            return FindLogger(name) != nullptr;
         }
 
         void AddLogger(const AsyncLogger::ptr &&AsyncLogger)
         {
-            if (LoggerExist(AsyncLogger->Name()))
-                return;
             std::unique_lock<std::mutex> lock(mtx_);
-            loggers_.insert(std::make_pair(AsyncLogger->Name(), AsyncLogger));
+            const Registry *cur = registry_.load(std::memory_order_relaxed);
+            if (cur->count(AsyncLogger->Name()))
+                return;
+            Registry *next = new Registry(*cur);
+            next->insert(std::make_pair(AsyncLogger->Name(), AsyncLogger));
+            retired_.emplace_back(next);
+            registry_.store(next, std::memory_order_release);
         }
 
         AsyncLogger::ptr GetLogger(const std::string &name)
         {
-            std::unique_lock<std::mutex> lock(mtx_);
-            auto it = loggers_.find(name);
-            if (it == loggers_.end())
+            const Registry *reg = registry_.load(std::memory_order_acquire);
+            auto it = reg->find(name);
+            if (it == reg->end())
                 return AsyncLogger::ptr();
             return it->second;
         }
 
+        // 不复制 shared_ptr 的查找，日志器由管理器一直持有，返回的指针在进程内有效；没有时返回 nullptr
+        AsyncLogger *FindLogger(const std::string &name) const
+        {
+            const Registry *reg = registry_.load(std::memory_order_acquire);
+            auto it = reg->find(name);
+            return it == reg->end() ? nullptr : it->second.get();
+        }
+
         AsyncLogger::ptr DefaultLogger() { return default_logger_; }
 
     private:
+        using Registry = std::unordered_map<std::string, AsyncLogger::ptr>;
+
         LoggerManager()
         {
             std::unique_ptr<LoggerBuilder> builder(new LoggerBuilder());
             builder->BuildLoggerName("default");
             default_logger_ = builder->Build();
-            loggers_.insert(std::make_pair("default", default_logger_));
+            Registry *reg = new Registry;
+            reg->insert(std::make_pair("default", default_logger_));
+            retired_.emplace_back(reg);
+            registry_.store(reg, std::memory_order_release);
         }
 
     private:
-        std::mutex mtx_;
+        std::mutex mtx_; // 只串行化添加
         AsyncLogger::ptr default_logger_;                              // 默认日志器
-        std::unordered_map<std::string, AsyncLogger::ptr> loggers_; // 存放日志器
+        std::atomic<const Registry *> registry_{nullptr};              // 当前的日志器表
+        std::vector<std::unique_ptr<const Registry>> retired_;         // 发布过的所有表，包括当前的
+    };
+
+    // 调用点缓存的日志器句柄：第一次使用时按名字查找，找到后缓存指针，之后每次只是一次原子读
+    // 名字还没有注册时退回默认日志器，但不缓存，注册之后的调用会拿到正确的日志器
+    class LoggerHandle
+    {
+    public:
+        explicit LoggerHandle(const char *name) : name_(name) {}
+
+        AsyncLogger *operator->() { return Get(); }
+
+        AsyncLogger *Get()
+        {
+            AsyncLogger *logger = cached_.load(std::memory_order_acquire);
+            if (logger != nullptr)
+                return logger;
+            logger = LoggerManager::GetInstance().FindLogger(name_);
+            if (logger == nullptr)
+                return LoggerManager::GetInstance().DefaultLogger().get();
+            cached_.store(logger, std::memory_order_release);
+            return logger;
+        }
+
+    private:
+        const char *name_;
+        std::atomic<AsyncLogger *> cached_{nullptr};
     };
-}
\ No newline at end of file
+}
@@ -1,56 +1,139 @@
 #pragma once
 
 #include <memory>
-#include <thread>
+#include <pthread.h>
 #include <atomic>   // 这里改了一下
-#include <sstream>  // 引入 sstream 头文件以使用 stringstream
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
 
 #include "Level.hpp"
 #include "Util.hpp"
 
 namespace mylog
 {
-    // 定义一个全局原子的序列号，给日志的。
-    static std::atomic<uint64_t> g_sequence_id_allocator(0);
+    class MessagePool;
+
+    // 一条日志记录。热路径上的记录来自 MessagePool，用完回收复用，不随每条日志分配释放
+    // 文件名和日志器名只保存指针：文件名来自 __FILE__，日志器名由日志器持有，都比记录活得长
+    // 正文不超过 kInlinePayload 时直接存在记录内部，更长的放在记录自带的溢出缓冲区里，回收后容量保留
     struct LogMessage
     {
-        using ptr = std::shared_ptr<LogMessage>;
+        static constexpr size_t kInlinePayload = 200;
+        static constexpr size_t kFormatBuffer = 4096;
+
         LogMessage() = default;
-        LogMessage(LogLevel::value level, const std::string& file, size_t line,
-                   const std::string& name, const std::string& payload)
-            : level_(level),
-              file_name_(file),
-              line_(line),
-              name_(name),
-              payload_(payload),
-              ctime_(Util::Date::Now()),
-              tid_(std::this_thread::get_id()),
-              sequence_id_(0)
-        {}
-
-        std::string format()
-        {
-            std::stringstream ret;
-            // 获取当前时间
-            struct tm t;
-            localtime_r(&ctime_, &t);
-            char buf[128];
-            strftime(buf, sizeof(buf), "%H:%M:%S", &t);
-            // 日志的格式: [时间][线程ID][日志级别][日志器名][文件名:行号] <Tab> 日志正文 <换行>
-            std::string tmp1 = '[' + std::string(buf) + "][";
-            std::string tmp2 = "][" + std::string(LogLevel::ToString(level_)) + "][" + name_ + "][" + file_name_ + ":" + std::to_string(line_) + "]\t" + payload_ + "\n";
-            ret << tmp1 << tid_ << tmp2;
-            return ret.str();
-        }
-
-        time_t ctime_;          // 时间戳
-        std::thread::id tid_;   // 线程id
-        LogLevel::value level_; // 日志等级
-        size_t line_;           // 行号
-        std::string file_name_; // 文件名
-        std::string name_;      // 日志器名
-        std::string payload_;   // 日志正文
-
-        uint64_t sequence_id_;
+        LogMessage(LogLevel::value level, const char* file, size_t line,
+                   const char* name, std::string_view payload)
+        {
+            Init(level, file, line, name);
+            SetPayload(payload.data(), payload.size());
+        }
+
+        LogMessage(const LogMessage&) = delete;
+        LogMessage& operator=(const LogMessage&) = delete;
+
+        // 从池中取出后重新填写记录头
+        void Init(LogLevel::value level, const char* file, size_t line, const char* name)
+        {
+            level_ = level;
+            file_name_ = file;
+            line_ = line;
+            name_ = name;
+            ctime_ = Util::Date::Now();
+            tid_ = CurrentTid();
+            sequence_id_ = 0;
+            site_id_ = 0;
+            structured_ = false;
+            payload_size_ = 0;
+            overflow_used_ = false;
+        }
+
+        // 返回至少 n+1 字节的可写区域，写完后调用 SetPayloadSize(n)
+        char* PayloadBuffer(size_t n)
+        {
+            if (n < kInlinePayload) {
+                overflow_used_ = false;
+                return inline_;
+            }
+            overflow_used_ = true;
+            overflow_.resize(n);
+            return &overflow_[0];
+        }
+
+        void SetPayloadSize(size_t n) { payload_size_ = n; }
+
+        void SetPayload(const char* data, size_t n)
+        {
+            memcpy(PayloadBuffer(n), data, n);
+            payload_size_ = n;
+        }
+
+        // 按 printf 格式生成正文。先写进线程私有的 kFormatBuffer 字节缓冲区，一次 vsnprintf 就能得到
+        // 绝大多数日志的完整正文，再拷进内联区或溢出缓冲区；只有超过缓冲区的正文才按实际长度再格式化一次
+        bool FormatPayload(const char* format, va_list va)
+        {
+            char* buf = FormatBuffer();
+            va_list va_copy;
+            va_copy(va_copy, va);
+            int len = vsnprintf(buf, kFormatBuffer, format, va_copy);
+            va_end(va_copy);
+
+            if (len < 0) return false;
+            if (static_cast<size_t>(len) < kFormatBuffer) {
+                SetPayload(buf, len);
+            } else {
+                vsnprintf(PayloadBuffer(len), len + 1, format, va);
+                payload_size_ = len;
+            }
+            return true;
+        }
+
+        // 记录占用的内存，包括溢出缓冲区
+        size_t Footprint() const
+        {
+            return sizeof(LogMessage) + (overflow_used_ ? overflow_.capacity() : 0);
+        }
+
+        std::string_view Payload() const
+        {
+            return std::string_view(overflow_used_ ? overflow_.data() : inline_, payload_size_);
+        }
+
+        // 和 std::thread::id 输出的值一致，每个线程只取一次
+        static uint64_t CurrentTid()
+        {
+            thread_local const uint64_t tid = static_cast<uint64_t>(pthread_self());
+            return tid;
+        }
+
+        time_t ctime_ = 0;                  // 时间戳
+        uint64_t tid_ = 0;                  // 线程id
+        LogLevel::value level_ = LogLevel::value::DEBUG; // 日志等级
+        size_t line_ = 0;                   // 行号
+        const char* file_name_ = "";        // 文件名
+        const char* name_ = "";             // 日志器名
+
+        uint64_t sequence_id_ = 0;  // 由所属流水线的主循环按出队顺序分配
+        uint32_t site_id_ = 0;      // 二进制日志的调用点id，此时文件名/行号取自调用点，正文是编码后的参数
+        bool structured_ = false;   // 结构化日志，正文是编码后的事件名和字段，见 Structured.hpp
+
+    private:
+        friend class MessagePool;
+
+        static char* FormatBuffer()
+        {
+            thread_local char buf[kFormatBuffer];
+            return buf;
+        }
+
+        size_t payload_size_ = 0;
+        bool overflow_used_ = false;
+        LogMessage* next_free_ = nullptr; // 在池的空闲链表中时使用
+        std::string overflow_;            // 超长正文
+        char inline_[kInlinePayload];     // 日志正文
     };
 } // namespace mylog
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Message.hpp"
+
+namespace mylog
+{
+    // LogMessage 记录池
+    // 记录按 kSlabSize 个一块(slab)整块分配，之后只在空闲链表之间流转，不再释放
+    // 每个线程有自己的空闲链表：生产者线程从中取，格式化线程把用完的记录还到自己的链表
+    // 本地链表攒多了按 kChunkSize 个一组交给全局，本地取空了再从全局领一组，全局锁每组才加一次
+    class MessagePool
+    {
+    public:
+        struct Deleter
+        {
+            void operator()(LogMessage* msg) const { MessagePool::Release(msg); }
+        };
+        using Ptr = std::unique_ptr<LogMessage, Deleter>;
+
+        // 取一条记录，内容需要调用方通过 Init 重新填写
+        static Ptr Acquire()
+        {
+            LocalCache* cache = Local();
+            if (cache == nullptr) {
+                // 线程正在退出，本地链表已经销毁
+                FreeList list;
+                TakeChunk(&list);
+                LogMessage* msg = list.Pop();
+                if (!list.Empty()) GiveChunk(list);
+                return Ptr(msg);
+            }
+            if (cache->list.Empty()) TakeChunk(&cache->list);
+            return Ptr(cache->list.Pop());
+        }
+
+        static void Release(LogMessage* msg)
+        {
+            // 偶尔出现的超长正文不要一直占着内存
+            if (msg->overflow_.capacity() > kMaxRetainedOverflow) {
+                std::string().swap(msg->overflow_);
+            }
+            LocalCache* cache = Local();
+            if (cache == nullptr) {
+                FreeList list;
+                list.Push(msg);
+                GiveChunk(list);
+                return;
+            }
+            cache->list.Push(msg);
+            if (cache->list.count >= 2 * kChunkSize) {
+                GiveChunk(cache->list.Split(kChunkSize));
+            }
+        }
+
+    private:
+        static constexpr size_t kChunkSize = 64;
+        static constexpr size_t kSlabSize = 256;
+        static constexpr size_t kMaxRetainedOverflow = 64 * 1024;
+
+        struct FreeList
+        {
+            LogMessage* head = nullptr;
+            size_t count = 0;
+
+            bool Empty() const { return head == nullptr; }
+
+            void Push(LogMessage* msg)
+            {
+                msg->next_free_ = head;
+                head = msg;
+                ++count;
+            }
+
+            LogMessage* Pop()
+            {
+                LogMessage* msg = head;
+                head = msg->next_free_;
+                msg->next_free_ = nullptr;
+                --count;
+                return msg;
+            }
+
+            // 从表头拆出 n 个
+            FreeList Split(size_t n)
+            {
+                FreeList ret;
+                while (ret.count < n && !Empty()) {
+                    ret.Push(Pop());
+                }
+                return ret;
+            }
+        };
+
+        struct Global
+        {
+            std::mutex mtx;
+            std::vector<FreeList> chunks;
+        };
+
+        struct LocalCache
+        {
+            FreeList list;
+            ~LocalCache()
+            {
+                LocalDead() = true;
+                if (!list.Empty()) GiveChunk(list);
+            }
+        };
+
+        // 故意不析构，保证线程局部的链表在进程退出时还能归还
+        static Global& Shared()
+        {
+            static Global* global = new Global;
+            return *global;
+        }
+
+        static bool& LocalDead()
+        {
+            thread_local bool dead = false;
+            return dead;
+        }
+
+        static LocalCache* Local()
+        {
+            if (LocalDead()) return nullptr;
+            thread_local LocalCache cache;
+            return &cache;
+        }
+
+        static void GiveChunk(const FreeList& list)
+        {
+            Global& g = Shared();
+            std::lock_guard<std::mutex> lock(g.mtx);
+            g.chunks.push_back(list);
+        }
+
+        // 从全局领一组，全局也没有时新分配一整块
+        static void TakeChunk(FreeList* list)
+        {
+            Global& g = Shared();
+            {
+                std::lock_guard<std::mutex> lock(g.mtx);
+                if (!g.chunks.empty()) {
+                    *list = g.chunks.back();
+                    g.chunks.pop_back();
+                    return;
+                }
+            }
+            LogMessage* slab = new LogMessage[kSlabSize];
+            for (size_t i = 0; i < kSlabSize; ++i) {
+                list->Push(&slab[i]);
+            }
+        }
+    };
+
+    using MessagePtr = MessagePool::Ptr;
+} // namespace mylog
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace mylog
+{
+    // 有界的多生产者单消费者环形队列，槽位预先分配，入队出队都不加锁
+    // 每个槽位带一个序号：序号 == 写位置 表示可写，序号 == 写位置+1 表示可读
+    // 生产者之间只在 enqueue_pos_ 上竞争一次 CAS，消费者独占 dequeue_pos_
+    template <typename T>
+    class MpscQueue
+    {
+    public:
+        // capacity 必须是2的幂
+        explicit MpscQueue(size_t capacity)
+            : mask_(capacity - 1),
+              cells_(new Cell[capacity])
+        {
+            for (size_t i = 0; i < capacity; ++i)
+                cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        MpscQueue(const MpscQueue &) = delete;
+        MpscQueue &operator=(const MpscQueue &) = delete;
+
+        // 队列满时返回false，不会阻塞
+        bool TryPush(T &&value)
+        {
+            size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+            Cell *cell;
+            while (true)
+            {
+                cell = &cells_[pos & mask_];
+                size_t seq = cell->seq.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                if (diff == 0)
+                {
+                    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    return false; // 满了
+                }
+                else
+                {
+                    pos = enqueue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+            cell->data = std::move(value);
+            cell->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // 只能由唯一的消费者调用，队列空时返回false
+        bool TryPop(T &value)
+        {
+            Cell *cell = &cells_[dequeue_pos_ & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(dequeue_pos_ + 1) < 0)
+                return false;
+            value = std::move(cell->data);
+            cell->seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+            ++dequeue_pos_;
+            return true;
+        }
+
+        // 只能由消费者调用
+        bool Empty() const
+        {
+            const Cell *cell = &cells_[dequeue_pos_ & mask_];
+            return cell->seq.load(std::memory_order_acquire) != dequeue_pos_ + 1;
+        }
+
+        size_t Capacity() const { return mask_ + 1; }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> seq;
+            T data;
+        };
+
+        // 生产者和消费者的位置分开放在不同的缓存行，避免伪共享
+        alignas(64) std::atomic<size_t> enqueue_pos_{0};
+        alignas(64) size_t dequeue_pos_ = 0;
+        alignas(64) const size_t mask_;
+        std::unique_ptr<Cell[]> cells_;
+    };
+} // namespace mylog
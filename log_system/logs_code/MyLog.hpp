@@ -8,12 +8,47 @@ AsyncLogger::ptr GetLogger(const std::string &name) {
 // 用户获取默认日志器
 AsyncLogger::ptr DefaultLogger() { return LoggerManager::GetInstance().DefaultLogger(); }
 
+// 热路径上用这个代替 GetLogger(name)：每个调用点只按名字查找一次，之后不构造字符串、不查表、不动引用计数
+// name 必须是字符串字面量，例如 MYLOG_LOGGER("asynclogger")->Info("...")
+#define MYLOG_LOGGER(name)                                    \
+    ([]() -> mylog::AsyncLogger* {                            \
+        static mylog::LoggerHandle mylog_handle_(name);       \
+        return mylog_handle_.Get();                           \
+    }())
+
+// 编译期最低日志等级，0~4 依次对应 DEBUG/INFO/WARN/ERROR/FATAL，默认全部编译进来
+// 低于它的 Debug/Info 等宏调用在编译期就被去掉：格式串和参数都不会求值，只剩一个空的内联调用
+// 例如发布版本在编译选项里加 -DMYLOG_MIN_LEVEL=1 去掉所有 Debug 日志
+#ifndef MYLOG_MIN_LEVEL
+#define MYLOG_MIN_LEVEL 0
+#endif
+
 // 简化用户使用，宏函数默认填上文件吗+行号
+#if MYLOG_MIN_LEVEL <= 0
 #define Debug(fmt, ...) Debug(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#else
+#define Debug(fmt, ...) Disabled()
+#endif
+#if MYLOG_MIN_LEVEL <= 1
 #define Info(fmt, ...) Info(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#else
+#define Info(fmt, ...) Disabled()
+#endif
+#if MYLOG_MIN_LEVEL <= 2
 #define Warn(fmt, ...) Warn(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#else
+#define Warn(fmt, ...) Disabled()
+#endif
+#if MYLOG_MIN_LEVEL <= 3
 #define Error(fmt, ...) Error(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#else
+#define Error(fmt, ...) Disabled()
+#endif
+#if MYLOG_MIN_LEVEL <= 4
 #define Fatal(fmt, ...) Fatal(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#else
+#define Fatal(fmt, ...) Disabled()
+#endif
 
 // 无需获取日志器，默认标准输出
 #define LOGDEBUGDEFAULT(fmt, ...) mylog::DefaultLogger()->Debug(fmt, ##__VA_ARGS__)
@@ -21,4 +56,105 @@ AsyncLogger::ptr DefaultLogger() { return LoggerManager::GetInstance().DefaultLo
 #define LOGWARNDEFAULT(fmt, ...) mylog::DefaultLogger()->Warn(fmt, ##__VA_ARGS__)
 #define LOGERRORDEFAULT(fmt, ...) mylog::DefaultLogger()->Error(fmt, ##__VA_ARGS__)
 #define LOGFATALDEFAULT(fmt, ...) mylog::DefaultLogger()->Fatal(fmt, ##__VA_ARGS__)
+
+// 二进制日志：调用点在第一次执行时登记，之后每次只记录参数，格式化推迟到离线解码
+// fmt 必须是字符串字面量，参数支持整数、浮点、字符串和指针
+#define LOGBIN(logger, level, fmt, ...)                                                                    \
+    do {                                                                                                   \
+        static const uint32_t mylog_site_id_ = mylog::BinarySites::Register(level, __FILE__, __LINE__, fmt); \
+        auto&& mylog_logger_ = (logger);                                                                   \
+        if (mylog_logger_->ShouldLog(level)) mylog_logger_->LogBinary(mylog_site_id_, ##__VA_ARGS__);     \
+    } while (0)
+#if MYLOG_MIN_LEVEL <= 0
+#define LOGBINDEBUG(logger, fmt, ...) LOGBIN(logger, mylog::LogLevel::value::DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOGBINDEBUG(logger, fmt, ...) do {} while (0)
+#endif
+#if MYLOG_MIN_LEVEL <= 1
+#define LOGBININFO(logger, fmt, ...) LOGBIN(logger, mylog::LogLevel::value::INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOGBININFO(logger, fmt, ...) do {} while (0)
+#endif
+#if MYLOG_MIN_LEVEL <= 2
+#define LOGBINWARN(logger, fmt, ...) LOGBIN(logger, mylog::LogLevel::value::WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOGBINWARN(logger, fmt, ...) do {} while (0)
+#endif
+#if MYLOG_MIN_LEVEL <= 3
+#define LOGBINERROR(logger, fmt, ...) LOGBIN(logger, mylog::LogLevel::value::ERROR, fmt, ##__VA_ARGS__)
+#else
+#define LOGBINERROR(logger, fmt, ...) do {} while (0)
+#endif
+#if MYLOG_MIN_LEVEL <= 4
+#define LOGBINFATAL(logger, fmt, ...) LOGBIN(logger, mylog::LogLevel::value::FATAL, fmt, ##__VA_ARGS__)
+#else
+#define LOGBINFATAL(logger, fmt, ...) do {} while (0)
+#endif
+
+// 调用点采样和限流：每个调用点一个静态状态，放不放行只要一两次原子操作
+// 被拦下的日志不格式化、不入队，只计数，日志器每秒在原调用点的文件名、行号下汇报一次拦下的条数
+//   LOG_EVERY_N(logger, level, n, fmt, ...)    每 n 条输出一条(第1、n+1...条)
+//   LOG_EVERY_MS(logger, level, ms, fmt, ...)  每 ms 毫秒最多输出一条
+//   LOG_LIMITED(logger, level, fmt, ...)       按日志器的 SetSiteRateLimit(配置 site_rate_limit/site_rate_burst) 限流
+// 例如 INFO_EVERY_MS(MYLOG_LOGGER("asynclogger"), 1000, "get req, uri: %s", uri)
+#define MYLOG_SAMPLED(logger, level, mode, n, admit, fmt, ...)                                                      \
+    do {                                                                                                            \
+        static mylog::SampledSite mylog_sampled_(__FILE__, __LINE__, level, mylog::SampledSite::Mode::mode, n);     \
+        auto&& mylog_logger_ = (logger);                                                                            \
+        if (mylog_logger_->ShouldLog(level)) {                                                                      \
+            if (admit) mylog_logger_->Log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__);                          \
+            else mylog_logger_->Suppressed(mylog_sampled_);                                                         \
+        }                                                                                                           \
+    } while (0)
+#define LOG_EVERY_N(logger, level, n, fmt, ...) \
+    MYLOG_SAMPLED(logger, level, EVERY_N, n, mylog_sampled_.EveryN(), fmt, ##__VA_ARGS__)
+#define LOG_EVERY_MS(logger, level, ms, fmt, ...) \
+    MYLOG_SAMPLED(logger, level, EVERY_MS, ms, mylog_sampled_.EveryMs(), fmt, ##__VA_ARGS__)
+#define LOG_LIMITED(logger, level, fmt, ...) \
+    MYLOG_SAMPLED(logger, level, LIMITED, 0, mylog_logger_->AdmitLimited(mylog_sampled_), fmt, ##__VA_ARGS__)
+#if MYLOG_MIN_LEVEL <= 0
+#define DEBUG_EVERY_N(logger, n, fmt, ...) LOG_EVERY_N(logger, mylog::LogLevel::value::DEBUG, n, fmt, ##__VA_ARGS__)
+#define DEBUG_EVERY_MS(logger, ms, fmt, ...) LOG_EVERY_MS(logger, mylog::LogLevel::value::DEBUG, ms, fmt, ##__VA_ARGS__)
+#define DEBUG_LIMITED(logger, fmt, ...) LOG_LIMITED(logger, mylog::LogLevel::value::DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define DEBUG_EVERY_N(logger, n, fmt, ...) do {} while (0)
+#define DEBUG_EVERY_MS(logger, ms, fmt, ...) do {} while (0)
+#define DEBUG_LIMITED(logger, fmt, ...) do {} while (0)
+#endif
+#if MYLOG_MIN_LEVEL <= 1
+#define INFO_EVERY_N(logger, n, fmt, ...) LOG_EVERY_N(logger, mylog::LogLevel::value::INFO, n, fmt, ##__VA_ARGS__)
+#define INFO_EVERY_MS(logger, ms, fmt, ...) LOG_EVERY_MS(logger, mylog::LogLevel::value::INFO, ms, fmt, ##__VA_ARGS__)
+#define INFO_LIMITED(logger, fmt, ...) LOG_LIMITED(logger, mylog::LogLevel::value::INFO, fmt, ##__VA_ARGS__)
+#else
+#define INFO_EVERY_N(logger, n, fmt, ...) do {} while (0)
+#define INFO_EVERY_MS(logger, ms, fmt, ...) do {} while (0)
+#define INFO_LIMITED(logger, fmt, ...) do {} while (0)
+#endif
+#if MYLOG_MIN_LEVEL <= 2
+#define WARN_EVERY_N(logger, n, fmt, ...) LOG_EVERY_N(logger, mylog::LogLevel::value::WARN, n, fmt, ##__VA_ARGS__)
+#define WARN_EVERY_MS(logger, ms, fmt, ...) LOG_EVERY_MS(logger, mylog::LogLevel::value::WARN, ms, fmt, ##__VA_ARGS__)
+#define WARN_LIMITED(logger, fmt, ...) LOG_LIMITED(logger, mylog::LogLevel::value::WARN, fmt, ##__VA_ARGS__)
+#else
+#define WARN_EVERY_N(logger, n, fmt, ...) do {} while (0)
+#define WARN_EVERY_MS(logger, ms, fmt, ...) do {} while (0)
+#define WARN_LIMITED(logger, fmt, ...) do {} while (0)
+#endif
+#if MYLOG_MIN_LEVEL <= 3
+#define ERROR_EVERY_N(logger, n, fmt, ...) LOG_EVERY_N(logger, mylog::LogLevel::value::ERROR, n, fmt, ##__VA_ARGS__)
+#define ERROR_EVERY_MS(logger, ms, fmt, ...) LOG_EVERY_MS(logger, mylog::LogLevel::value::ERROR, ms, fmt, ##__VA_ARGS__)
+#define ERROR_LIMITED(logger, fmt, ...) LOG_LIMITED(logger, mylog::LogLevel::value::ERROR, fmt, ##__VA_ARGS__)
+#else
+#define ERROR_EVERY_N(logger, n, fmt, ...) do {} while (0)
+#define ERROR_EVERY_MS(logger, ms, fmt, ...) do {} while (0)
+#define ERROR_LIMITED(logger, fmt, ...) do {} while (0)
+#endif
+#if MYLOG_MIN_LEVEL <= 4
+#define FATAL_EVERY_N(logger, n, fmt, ...) LOG_EVERY_N(logger, mylog::LogLevel::value::FATAL, n, fmt, ##__VA_ARGS__)
+#define FATAL_EVERY_MS(logger, ms, fmt, ...) LOG_EVERY_MS(logger, mylog::LogLevel::value::FATAL, ms, fmt, ##__VA_ARGS__)
+#define FATAL_LIMITED(logger, fmt, ...) LOG_LIMITED(logger, mylog::LogLevel::value::FATAL, fmt, ##__VA_ARGS__)
+#else
+#define FATAL_EVERY_N(logger, n, fmt, ...) do {} while (0)
+#define FATAL_EVERY_MS(logger, ms, fmt, ...) do {} while (0)
+#define FATAL_LIMITED(logger, fmt, ...) do {} while (0)
+#endif
 }  // namespace mylog
\ No newline at end of file
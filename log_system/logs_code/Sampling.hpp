@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+
+#include "Level.hpp"
+
+// 调用点级别的采样和限流，由 MyLog.hpp 里的 *_EVERY_N / *_EVERY_MS / *_LIMITED 宏使用
+// 每个调用点一个静态的 SampledSite，决定放不放行只要一两次原子操作，被拦下的日志不会格式化
+// 被拦下的条数记在调用点上，日志器的主循环每秒在原调用点的文件名、行号下汇报一次，不会悄悄丢掉
+namespace mylog
+{
+    class SampledSite
+    {
+    public:
+        enum class Mode
+        {
+            EVERY_N,  // 每 n 条放行一条
+            EVERY_MS, // 每 n 毫秒最多放行一条
+            LIMITED   // 按日志器配置的速率和突发量限流(令牌桶)
+        };
+
+        // constexpr 构造，宏里的静态对象是常量初始化，每次调用不需要检查是否已初始化
+        constexpr SampledSite(const char* file, uint32_t line, LogLevel::value level, Mode mode, uint64_t n = 0)
+            : file_(file), line_(line), level_(level), mode_(mode), n_(std::max<uint64_t>(n, 1))
+        {}
+
+        SampledSite(const SampledSite&) = delete;
+        SampledSite& operator=(const SampledSite&) = delete;
+
+        // 第 1、n+1、2n+1... 条放行
+        bool EveryN()
+        {
+            return counter_.fetch_add(1, std::memory_order_relaxed) % n_ == 0;
+        }
+
+        // 距上次放行不到 n 毫秒的拦下，同一时刻多个线程只有抢到的那个放行
+        bool EveryMs()
+        {
+            int64_t now = NowNs();
+            int64_t next = next_ns_.load(std::memory_order_relaxed);
+            if (now < next) return false;
+            return next_ns_.compare_exchange_strong(next, now + static_cast<int64_t>(n_) * 1000000,
+                                                    std::memory_order_relaxed);
+        }
+
+        // 令牌桶的无锁写法(GCRA)：tat_ 是按速率排到的下一个放行时刻，最多可以提前 tolerance_ns 放行
+        // interval_ns 为 0 表示不限流
+        bool Limited(int64_t interval_ns, int64_t tolerance_ns)
+        {
+            if (interval_ns <= 0) return true;
+            int64_t now = NowNs();
+            int64_t tat = tat_.load(std::memory_order_relaxed);
+            while (true) {
+                int64_t base = std::max(tat, now);
+                if (base - now > tolerance_ns) return false;
+                if (tat_.compare_exchange_weak(tat, base + interval_ns, std::memory_order_relaxed)) return true;
+            }
+        }
+
+        // 记一条被拦下的日志；返回 true 表示这是第一次，调用方需要把调用点登记到日志器上等待汇报
+        bool Suppress()
+        {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return !tracked_.load(std::memory_order_relaxed) && !tracked_.exchange(true, std::memory_order_relaxed);
+        }
+
+        // 取走上次汇报之后被拦下的条数
+        uint64_t TakeSuppressed() { return suppressed_.exchange(0, std::memory_order_relaxed); }
+
+        // 汇报用的说明文字
+        int Describe(char* buf, size_t size) const
+        {
+            switch (mode_) {
+                case Mode::EVERY_N:
+                    return snprintf(buf, size, "every %llu", static_cast<unsigned long long>(n_));
+                case Mode::EVERY_MS:
+                    return snprintf(buf, size, "every %llu ms", static_cast<unsigned long long>(n_));
+                default:
+                    return snprintf(buf, size, "rate limit");
+            }
+        }
+
+        const char* File() const { return file_; }
+        uint32_t Line() const { return line_; }
+        LogLevel::value Level() const { return level_; }
+
+    private:
+        static int64_t NowNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        const char* file_;
+        const uint32_t line_;
+        const LogLevel::value level_;
+        const Mode mode_;
+        const uint64_t n_;
+
+        std::atomic<uint64_t> counter_{0};
+        std::atomic<int64_t> next_ns_{0};
+        std::atomic<int64_t> tat_{0};
+        std::atomic<uint64_t> suppressed_{0};
+        std::atomic<bool> tracked_{false};
+    };
+
+    // 日志器在进程退出时还会汇报一次，那时调用点的静态对象可能已经过了析构，必须没有析构动作
+    static_assert(std::is_trivially_destructible<SampledSite>::value, "SampledSite must outlive loggers");
+} // namespace mylog
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "LogFlush.hpp"
+
+namespace mylog
+{
+    // IO线程整理好的一批日志，由各落地器的写线程共同持有，不为每个落地器复制
+    using LogBatch = std::shared_ptr<const std::string>;
+
+    // 一个落地器和它专属的写线程
+    // IO线程只把批次放进队列，写得慢甚至卡住的落地器只会让自己的队列变长，不影响其它落地器和流水线
+    // 队列按字节数设上限，超出时按策略阻塞IO线程或丢掉这一批
+    class SinkWriter
+    {
+    public:
+        enum class Overflow
+        {
+            BLOCK, // 等这个落地器追上来，最慢的落地器会拖慢整条流水线，但一条不丢
+            DROP   // 这个落地器丢掉新批次，其它落地器不受影响
+        };
+
+        static Overflow OverflowFromString(const std::string& name)
+        {
+            return name == "drop" ? Overflow::DROP : Overflow::BLOCK;
+        }
+
+        SinkWriter(const LogFlush::ptr& flusher, size_t max_bytes, Overflow overflow)
+            : flusher_(flusher), max_bytes_(max_bytes), overflow_(overflow)
+        {
+            thread_ = std::thread(&SinkWriter::WriterThreadEntry, this);
+        }
+
+        ~SinkWriter() { Stop(); }
+
+        SinkWriter(const SinkWriter&) = delete;
+        SinkWriter& operator=(const SinkWriter&) = delete;
+
+        // 只在IO线程调用。droppable 为 false 的批次(如二进制文件头和调用点登记)即使超限也不丢
+        void Enqueue(const LogBatch& batch, bool droppable = true)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            // 队列为空时总是接收，单批超过上限也不会卡死
+            if (!queue_.empty() && queued_bytes_ + batch->size() > max_bytes_) {
+                if (overflow_ == Overflow::DROP && droppable) {
+                    if (!dropping_) {
+                        fprintf(stderr, "mylog: sink fell %zu bytes behind, dropping batches\n", queued_bytes_);
+                        dropping_ = true;
+                    }
+                    dropped_bytes_ += batch->size();
+                    ++dropped_batches_;
+                    return;
+                }
+                cond_space_.wait(lock, [&] {
+                    return queue_.empty() || queued_bytes_ + batch->size() <= max_bytes_;
+                });
+            }
+            dropping_ = false;
+            queue_.push_back(QueuedBatch{batch, std::chrono::steady_clock::now()});
+            queued_bytes_ += batch->size();
+            lock.unlock();
+            cond_.notify_one();
+        }
+
+        // 写完队列里剩下的批次后退出
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (stop_) return;
+                stop_ = true;
+            }
+            cond_.notify_one();
+            thread_.join();
+        }
+
+        // 积压情况：排队的字节数，最老一批已经等了多久(滞后)，以及历史最大滞后、丢弃量和写失败量
+        std::string Report() const
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            double lag_ms = 0;
+            if (!queue_.empty()) {
+                lag_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                   queue_.front().enqueued).count();
+            }
+            char buf[320];
+            snprintf(buf, sizeof(buf),
+                     "written %llu bytes in %llu batches, queued %zu bytes, lag %.3f ms (max %.3f ms), "
+                     "dropped %llu bytes in %llu batches, failed %llu bytes in %llu batches",
+                     static_cast<unsigned long long>(written_bytes_), static_cast<unsigned long long>(written_batches_),
+                     queued_bytes_, lag_ms, std::chrono::duration<double, std::milli>(max_lag_).count(),
+                     static_cast<unsigned long long>(dropped_bytes_), static_cast<unsigned long long>(dropped_batches_),
+                     static_cast<unsigned long long>(failed_bytes_), static_cast<unsigned long long>(failed_batches_));
+            return buf;
+        }
+
+    private:
+        struct QueuedBatch
+        {
+            LogBatch data;
+            std::chrono::steady_clock::time_point enqueued;
+        };
+
+        void WriterThreadEntry()
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            while (true) {
+                cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) break; // 已停止且写完
+                QueuedBatch batch = std::move(queue_.front());
+                queue_.pop_front();
+                lock.unlock();
+
+                // 落地器内部出错(如内存不足)时这一批没有写出去，单独计数，不能算作已写
+                bool ok = true;
+                try {
+                    flusher_->Flush(batch.data->data(), batch.data->size());
+                } catch (const std::exception&) {
+                    ok = false;
+                }
+                auto lag = std::chrono::steady_clock::now() - batch.enqueued;
+                size_t size = batch.data->size();
+                batch.data.reset(); // 在锁外释放，最后一个持有者负责回收
+
+                lock.lock();
+                queued_bytes_ -= size;
+                if (ok) {
+                    written_bytes_ += size;
+                    ++written_batches_;
+                } else {
+                    failed_bytes_ += size;
+                    ++failed_batches_;
+                }
+                if (lag > max_lag_) max_lag_ = lag;
+                cond_space_.notify_one();
+            }
+        }
+
+    private:
+        LogFlush::ptr flusher_;
+        const size_t max_bytes_;
+        const Overflow overflow_;
+
+        mutable std::mutex mtx_;
+        std::condition_variable cond_;       // 写线程等新批次
+        std::condition_variable cond_space_; // BLOCK 策略下IO线程等队列腾出空间
+        std::deque<QueuedBatch> queue_;
+        size_t queued_bytes_ = 0;
+        bool stop_ = false;
+        bool dropping_ = false; // 正处于丢弃中，只在开始丢弃时提示一次
+
+        uint64_t written_bytes_ = 0;
+        uint64_t written_batches_ = 0;
+        uint64_t dropped_bytes_ = 0;
+        uint64_t dropped_batches_ = 0;
+        uint64_t failed_bytes_ = 0;  // 写入时抛了异常的批次
+        uint64_t failed_batches_ = 0;
+        std::chrono::steady_clock::duration max_lag_{0}; // 从入队到写完的最大耗时
+        std::thread thread_;
+    };
+} // namespace mylog
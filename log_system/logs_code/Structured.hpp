@@ -0,0 +1,250 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "BinaryLog.hpp"
+#include "Level.hpp"
+#include "Message.hpp"
+
+// 结构化日志：Info("upload", mylog::kv("path", p), mylog::kv("bytes", n))
+// 调用线程只把事件名和各字段按 BinaryArgs 的类型标记编码进记录，不做任何格式化
+// 格式化线程再渲染成 logfmt(事件名 key=value ...) 或一行 JSON，字符串值按需转义
+namespace mylog
+{
+    // 一个字段：只保存键和值的引用，值在整条日志调用结束前有效，编码时直接拷进记录
+    template <typename T>
+    struct Field
+    {
+        const char* key;
+        const T& value;
+    };
+
+    // key 必须是字符串字面量或比这次调用活得长的字符串；值支持整数、浮点、字符串和指针
+    template <typename T>
+    Field<T> kv(const char* key, const T& value)
+    {
+        return Field<T>{key, value};
+    }
+
+    // 结构化记录没有格式串，渲染方式由配置的 structured_format 决定
+    enum class StructuredFormat
+    {
+        LOGFMT,
+        JSON
+    };
+
+    inline StructuredFormat StructuredFormatFromString(const std::string& name)
+    {
+        return name == "json" ? StructuredFormat::JSON : StructuredFormat::LOGFMT;
+    }
+
+    // 每个字节在字符串里的处理：0 原样输出，其他值是 \ 之后的转义字符，'u' 表示 \u00XX
+    struct StructuredEscape
+    {
+        char json[256] = {};
+        char logfmt[256] = {}; // logfmt 里需要加引号的字符，值同上；' ' 和 '=' 只需加引号
+        constexpr StructuredEscape()
+        {
+            for (int c = 0; c < 0x20; ++c) json[c] = 'u';
+            json['\n'] = 'n';
+            json['\r'] = 'r';
+            json['\t'] = 't';
+            json['\b'] = 'b';
+            json['\f'] = 'f';
+            json['"'] = '"';
+            json['\\'] = '\\';
+            for (int c = 0; c < 256; ++c) logfmt[c] = json[c];
+            logfmt[0x7f] = 'u';
+            logfmt[' '] = ' ';
+            logfmt['='] = '=';
+        }
+    };
+    inline constexpr StructuredEscape kStructuredEscape{};
+
+    // 记录正文的编码：事件名('s') + 每个字段的 键('s') 和 值(BinaryArgs 的类型标记)
+    class StructuredFields
+    {
+    public:
+        template <typename... Ts>
+        static size_t EncodedSize(const char* event, const Field<Ts>&... fields)
+        {
+            return (BinaryArgs::EncodedSize(event) + ... + BinaryArgs::EncodedSize(fields.key, fields.value));
+        }
+
+        // dst 至少要有 EncodedSize(event, fields...) 字节
+        template <typename... Ts>
+        static void Encode(char* dst, const char* event, const Field<Ts>&... fields)
+        {
+            dst = BinaryArgs::Encode(dst, event);
+            ((dst = BinaryArgs::Encode(dst, fields.key, fields.value)), ...);
+        }
+
+        // logfmt: upload path=/a/b bytes=123 note="has space"
+        static void RenderLogfmt(std::string_view payload, std::string* out)
+        {
+            BinaryArgs::Reader reader{payload.data(), payload.data() + payload.size()};
+            Value v;
+            if (Next(&reader, &v) != 's') return;
+            AppendLogfmtString(v.s, out);
+            while (Next(&reader, &v) == 's') {
+                out->push_back(' ');
+                AppendLogfmtString(v.s, out);
+                out->push_back('=');
+                char tag = Next(&reader, &v);
+                if (tag == 0) break;
+                if (tag == 's') AppendLogfmtString(v.s, out);
+                else AppendScalar(tag, v, false, out);
+            }
+        }
+
+        // 一行 JSON 对象，包含记录头：{"ts":...,"level":"INFO",...,"event":"upload","path":"/a/b","bytes":123}
+        static void RenderJson(const LogMessage& msg, std::string* out)
+        {
+            BinaryArgs::Reader reader{msg.Payload().data(), msg.Payload().data() + msg.Payload().size()};
+            Value v;
+            out->append("{\"ts\":");
+            AppendInt(static_cast<int64_t>(msg.ctime_), out);
+            out->append(",\"level\":\"");
+            out->append(LogLevel::ToString(msg.level_));
+            out->append("\",\"logger\":");
+            AppendJsonString(msg.name_, out);
+            out->append(",\"tid\":");
+            AppendUint(msg.tid_, out);
+            out->append(",\"file\":");
+            AppendJsonString(msg.file_name_, out);
+            out->append(",\"line\":");
+            AppendUint(msg.line_, out);
+            if (Next(&reader, &v) == 's') {
+                out->append(",\"event\":");
+                AppendJsonString(v.s, out);
+                while (Next(&reader, &v) == 's') {
+                    out->push_back(',');
+                    AppendJsonString(v.s, out);
+                    out->push_back(':');
+                    char tag = Next(&reader, &v);
+                    if (tag == 0) {
+                        out->append("null");
+                        break;
+                    }
+                    if (tag == 's') AppendJsonString(v.s, out);
+                    else AppendScalar(tag, v, true, out);
+                }
+            }
+            out->append("}\n");
+        }
+
+    private:
+        struct Value
+        {
+            int64_t i = 0;
+            uint64_t u = 0;
+            double d = 0;
+            std::string_view s;
+        };
+
+        static char Next(BinaryArgs::Reader* reader, Value* v)
+        {
+            return reader->Next(&v->i, &v->u, &v->d, &v->s);
+        }
+
+        static void AppendInt(int64_t v, std::string* out)
+        {
+            char buf[24];
+            auto res = std::to_chars(buf, buf + sizeof(buf), v);
+            out->append(buf, res.ptr - buf);
+        }
+
+        static void AppendUint(uint64_t v, std::string* out)
+        {
+            char buf[24];
+            auto res = std::to_chars(buf, buf + sizeof(buf), v);
+            out->append(buf, res.ptr - buf);
+        }
+
+        // 非字符串的值；JSON 里指针写成字符串，非有限的浮点写成 null
+        static void AppendScalar(char tag, const Value& v, bool json, std::string* out)
+        {
+            char buf[32];
+            switch (tag) {
+                case 'i':
+                    AppendInt(v.i, out);
+                    break;
+                case 'u':
+                    AppendUint(v.u, out);
+                    break;
+                case 'd': {
+                    if (json && !std::isfinite(v.d)) {
+                        out->append("null");
+                        break;
+                    }
+                    auto res = std::to_chars(buf, buf + sizeof(buf), v.d);
+                    out->append(buf, res.ptr - buf);
+                    break;
+                }
+                case 'p': {
+                    if (json) out->push_back('"');
+                    out->append("0x");
+                    auto res = std::to_chars(buf, buf + sizeof(buf), v.u, 16);
+                    out->append(buf, res.ptr - buf);
+                    if (json) out->push_back('"');
+                    break;
+                }
+            }
+        }
+
+        // 连续不需要转义的字节整段追加，只有碰到特殊字符才逐个处理
+        static void AppendEscaped(std::string_view s, const char* table, std::string* out)
+        {
+            const char* p = s.data();
+            const char* end = p + s.size();
+            const char* run = p;
+            for (; p < end; ++p) {
+                char e = table[static_cast<unsigned char>(*p)];
+                if (e == 0 || e == ' ' || e == '=') continue;
+                out->append(run, p - run);
+                out->push_back('\\');
+                if (e == 'u') {
+                    static const char kHex[] = "0123456789abcdef";
+                    unsigned char c = static_cast<unsigned char>(*p);
+                    char u[5] = {'u', '0', '0', kHex[c >> 4], kHex[c & 0xf]};
+                    out->append(u, sizeof(u));
+                } else {
+                    out->push_back(e);
+                }
+                run = p + 1;
+            }
+            out->append(run, end - run);
+        }
+
+        static void AppendJsonString(std::string_view s, std::string* out)
+        {
+            out->push_back('"');
+            AppendEscaped(s, kStructuredEscape.json, out);
+            out->push_back('"');
+        }
+
+        // 空串和含空白、引号、等号、控制字符的值才加引号
+        static void AppendLogfmtString(std::string_view s, std::string* out)
+        {
+            bool quote = s.empty();
+            for (char c : s) {
+                if (kStructuredEscape.logfmt[static_cast<unsigned char>(c)] != 0) {
+                    quote = true;
+                    break;
+                }
+            }
+            if (!quote) {
+                out->append(s.data(), s.size());
+                return;
+            }
+            out->push_back('"');
+            AppendEscaped(s, kStructuredEscape.logfmt, out);
+            out->push_back('"');
+        }
+    };
+} // namespace mylog
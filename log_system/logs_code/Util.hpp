@@ -167,16 +167,58 @@ namespace mylog
                 flush_log = root["flush_log"].asInt64();
                 backup_addr = root["backup_addr"].asString();
                 backup_port = root["backup_port"].asInt();
+                backup_enable = root.get("backup_enable", false).asBool();
+                backup_queue_bytes = root.get("backup_queue_bytes", 4 * 1024 * 1024).asUInt64();
+                backup_batch_ms = root.get("backup_batch_ms", 50).asUInt64();
+                backup_spool = root.get("backup_spool", "").asString();
+                backup_spool_bytes = root.get("backup_spool_bytes", 256 * 1024 * 1024).asUInt64();
+                backup_replay_rate = root.get("backup_replay_rate", 1024 * 1024).asUInt64();
                 thread_count = root["thread_count"].asInt();
+                pattern = root.get("pattern", "").asString();
+                structured_format = root.get("structured_format", "logfmt").asString();
+                log_level = root.get("log_level", "DEBUG").asString();
+                overflow_policy = root.get("overflow_policy", "block").asString();
+                overflow_sample_rate = root.get("overflow_sample_rate", 10).asUInt64();
+                site_rate_limit = root.get("site_rate_limit", 0).asDouble();
+                site_rate_burst = root.get("site_rate_burst", 10).asDouble();
+                sync_interval_ms = root.get("sync_interval_ms", 100).asUInt64();
+                sync_bytes = root.get("sync_bytes", 4 * 1024 * 1024).asUInt64();
+                sync_thread = root.get("sync_thread", true).asBool();
+                sink_queue_bytes = root.get("sink_queue_bytes", 0).asUInt64();
+                sink_overflow = root.get("sink_overflow", "block").asString();
+                compress_rolled = root.get("compress_rolled", false).asBool();
+                retention_bytes = root.get("retention_bytes", 0).asUInt64();
+                retention_hours = root.get("retention_hours", 0).asUInt64();
             }
             public:
-                size_t buffer_size;//缓冲区基础容量
+                size_t buffer_size;//每个日志器最多积压的日志字节数(按记录占用的内存计)，0 表示不限制
                 size_t threshold;// 倍数扩容阈值
                 size_t linear_growth;// 线性增长容量
-                size_t flush_log;//控制日志同步到磁盘的时机，默认为0,1调用fflush，2调用fsync
+                size_t flush_log;//控制日志同步到磁盘的时机，默认为0,1每批调用fflush，2每批fflush并按下面的策略组提交fdatasync
+                size_t sync_interval_ms;// 未同步的数据最多等这么久就同步一次，也是掉电时的最大丢失窗口
+                size_t sync_bytes;// 未同步的数据超过这么多字节就提前同步
+                bool sync_thread;// 在专门的线程里同步，IO线程不等磁盘
+                size_t sink_queue_bytes;// 每个落地器的写线程最多排队的字节数，0 表示使用默认值 64MB
+                std::string sink_overflow;// 落地器排队超限时：block 等它追上，drop 丢掉这个落地器的新批次
+                bool compress_rolled;// 滚动关闭的分段在后台压缩成 .gz
+                size_t retention_bytes;// 已关闭分段的总大小上限，超出时删除最旧的，0 表示不限
+                size_t retention_hours;// 已关闭分段最多保留的小时数，0 表示不限
                 std::string backup_addr;
                 uint16_t backup_port;
+                bool backup_enable;// ERROR 及以上的日志通过长连接发往 backup_addr:backup_port
+                size_t backup_queue_bytes;// 连接不上时最多在内存里排队的字节数，超出的丢弃
+                size_t backup_batch_ms;// 第一条待发日志最多等这么久，和之后的合成一批发送
+                std::string backup_spool;// 连不上接收端时待发日志暂存的文件前缀，为空表示不暂存
+                size_t backup_spool_bytes;// 暂存文件的总大小上限，超出的日志丢弃
+                size_t backup_replay_rate;// 恢复后重放暂存的速度上限(字节/秒)，0 表示不限
                 size_t thread_count;
+                std::string pattern;// 日志格式，见 Formatter.hpp，为空时使用默认格式
+                std::string structured_format;// 结构化日志的输出：logfmt 按 pattern 输出、正文是 key=value，json 整行输出成 JSON 对象
+                std::string log_level;// 日志器的默认最低输出等级，运行时可用 AsyncLogger::SetLevel 单独调整
+                std::string overflow_policy;// 积压超过 buffer_size 时的处理：block/drop_newest/drop_below/sample
+                size_t overflow_sample_rate;// sample 策略下每多少条保留一条
+                double site_rate_limit;// *_LIMITED 宏每个调用点每秒最多输出的条数，0 表示不限
+                double site_rate_burst;// *_LIMITED 宏每个调用点最多连续输出的条数
         };
     } // namespace Util
 } // namespace mylog
@@ -0,0 +1,471 @@
+#pragma once
+// 远程备份ERROR等级以上的日志-发送端
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../Util.hpp"
+#include "BackupProtocol.hpp"
+#include "BackupSpool.hpp"
+
+extern mylog::Util::JsonData* g_conf_data;
+
+namespace mylog
+{
+    // 备份客户端：一个进程一条长连接，发送线程把一个时间窗口内的日志编码成一个批次帧(见 BackupProtocol.hpp)
+    // 最多 kMaxInFlight 个批次同时在途，收到接收端按 seq 的确认后才释放；
+    // 连接断开后按指数退避重连，重连后没确认的批次按原顺序重发(至少一次)
+    // 配置了磁盘暂存(BackupSpool)时，连不上接收端或内存队列过半，待发日志转存到磁盘；
+    // 暂存里还有没发出的记录时新日志都排在它后面，恢复后按 replay_rate 限速按顺序重放
+    // 没有暂存时新日志在有界内存队列里等待，队列满了就丢弃并计数
+    class BackupClient
+    {
+    public:
+        // spool_path 为空表示不用磁盘暂存；replay_rate 是重放暂存的字节数/秒，0 表示不限
+        BackupClient(const std::string& addr, uint16_t port, size_t max_queue_bytes,
+                     std::chrono::milliseconds batch_window, const std::string& spool_path = "",
+                     size_t spool_bytes = 0, size_t replay_rate = 0)
+            : addr_(addr), port_(port), max_queue_bytes_(max_queue_bytes), batch_window_(batch_window),
+              replay_rate_(replay_rate)
+        {
+            if (!spool_path.empty() && spool_bytes > 0) spool_.reset(new BackupSpool(spool_path, spool_bytes));
+            wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            thread_ = std::thread(&BackupClient::SenderThreadEntry, this);
+        }
+
+        ~BackupClient()
+        {
+            Shutdown();
+            if (sock_ >= 0) close(sock_);
+            close(wake_fd_);
+        }
+
+        BackupClient(const BackupClient&) = delete;
+        BackupClient& operator=(const BackupClient&) = delete;
+
+        // 按配置文件创建的进程级客户端，没有配置时返回 nullptr
+        // 故意不析构：进程退出时各日志器可能还在析构，仍会用到它
+        // 进程退出时只停掉发送线程，没发完的转存到磁盘，之后的日志直接写进暂存
+        static BackupClient* Shared()
+        {
+            static BackupClient* client = [] {
+                if (g_conf_data == nullptr) return static_cast<BackupClient*>(nullptr);
+                BackupClient* c = new BackupClient(g_conf_data->backup_addr, g_conf_data->backup_port,
+                                                   g_conf_data->backup_queue_bytes,
+                                                   std::chrono::milliseconds(g_conf_data->backup_batch_ms),
+                                                   g_conf_data->backup_spool, g_conf_data->backup_spool_bytes,
+                                                   g_conf_data->backup_replay_rate);
+                std::atexit([] { Shared()->Shutdown(); });
+                return c;
+            }();
+            return client;
+        }
+
+        // 停止发送线程：最多再等 kStopGrace 把队列和在途的批次发完并得到确认(连不上接收端时不等)，
+        // 剩下的转存到磁盘暂存。之后的 Enqueue 直接写暂存，没有暂存时丢弃
+        void Shutdown()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (stop_) return;
+                stop_ = true;
+                stop_deadline_ = std::chrono::steady_clock::now() + kStopGrace;
+            }
+            Wake();
+            thread_.join();
+        }
+
+        // 放进发送队列，队列已满时丢弃并返回 false
+        bool Enqueue(std::string line)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (stopped_) {
+                if (spool_ == nullptr || !spool_->Append(line)) {
+                    ++dropped_;
+                    return false;
+                }
+                spool_->Flush();
+                return true;
+            }
+            if (queued_bytes_ + line.size() > max_queue_bytes_) {
+                ++dropped_;
+                return false;
+            }
+            bool first = queue_.empty();
+            if (first) first_enqueued_ = std::chrono::steady_clock::now(); // 批次窗口从这里开始算
+            queued_bytes_ += line.size();
+            queue_.push_back(std::move(line));
+            lock.unlock();
+            if (first) Wake();
+            return true;
+        }
+
+        std::string Report() const
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            char buf[320];
+            snprintf(buf, sizeof(buf),
+                     "backup: acked %llu records (%llu bytes, %llu on the wire) in %llu batches, %llu resent, "
+                     "%llu connects, %llu dropped, %zu bytes queued",
+                     static_cast<unsigned long long>(acked_records_), static_cast<unsigned long long>(acked_bytes_),
+                     static_cast<unsigned long long>(wire_bytes_), static_cast<unsigned long long>(acked_batches_),
+                     static_cast<unsigned long long>(resent_batches_), static_cast<unsigned long long>(connects_),
+                     static_cast<unsigned long long>(dropped_), queued_bytes_);
+            return spool_ ? std::string(buf) + ", " + spool_->Report() : std::string(buf);
+        }
+
+    private:
+        static constexpr size_t kMaxBatchBytes = 256 * 1024; // 攒够这么多不等窗口结束
+        static constexpr size_t kMaxInFlight = 8;
+        static constexpr std::chrono::milliseconds kMinBackoff{100};
+        static constexpr std::chrono::milliseconds kMaxBackoff{10000};
+        static constexpr std::chrono::milliseconds kIdleWait{1000};
+        static constexpr std::chrono::milliseconds kStopGrace{1000};
+        static constexpr int kConnectTimeoutMs = 1000;
+
+        struct Batch
+        {
+            uint64_t seq = 0;
+            uint32_t records = 0;
+            size_t raw_bytes = 0;
+            std::string frame; // 编码好的整帧，重发时原样再发
+            bool sent = false; // 发完过一次，再发就算重发
+            bool from_spool = false;
+            BackupSpool::Position spool_end; // 确认后暂存的 cursor 推进到这里
+        };
+
+        void Wake()
+        {
+            uint64_t one = 1;
+            ssize_t ret = write(wake_fd_, &one, sizeof(one));
+            (void)ret;
+        }
+
+        // 发送线程用 poll 同时等：新日志(wake_fd_)、连接可写、确认到达、批次窗口到期、重连时间到
+        // inflight_、send_* 和连接只由发送线程访问
+        void SenderThreadEntry()
+        {
+            using clock = std::chrono::steady_clock;
+            std::chrono::milliseconds backoff = kMinBackoff;
+            clock::time_point next_connect;
+            clock::time_point last_refill = clock::now();
+            double replay_tokens = 0; // 重放的令牌桶，按字节计，最多攒一秒
+            bool offline = false;     // 上一次连接失败或断开，还没连上
+            std::vector<std::string> lines;
+            std::string raw;
+            while (true) {
+                clock::time_point now = clock::now();
+                clock::time_point deadline = now + kIdleWait;
+                bool take = false, spill = false;
+                bool spool_unread = spool_ && spool_->HasUnread();
+                {
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    if (stop_) {
+                        // 有暂存且连不上时不必等，剩下的转存
+                        if ((queue_.empty() && inflight_.empty()) || now >= stop_deadline_ || (spool_ && offline)) break;
+                        deadline = std::min(deadline, stop_deadline_);
+                    }
+                    // 暂存里还有记录时新日志也进暂存，保证顺序
+                    spill = spool_ && !queue_.empty() &&
+                            (offline || spool_unread || queued_bytes_ >= max_queue_bytes_ / 2);
+                    if (spill) {
+                        for (std::string& line : queue_) lines.push_back(std::move(line));
+                        queue_.clear();
+                        queued_bytes_ = 0;
+                    } else if (!queue_.empty() && inflight_.size() < kMaxInFlight) {
+                        clock::time_point window_end = first_enqueued_ + batch_window_;
+                        if (stop_ || queued_bytes_ >= kMaxBatchBytes || now >= window_end) {
+                            size_t bytes = 0;
+                            while (!queue_.empty() && bytes < kMaxBatchBytes) {
+                                bytes += queue_.front().size();
+                                lines.push_back(std::move(queue_.front()));
+                                queue_.pop_front();
+                            }
+                            queued_bytes_ -= bytes;
+                            first_enqueued_ = now;
+                            take = true;
+                        } else {
+                            deadline = std::min(deadline, window_end);
+                        }
+                    }
+                }
+                if (spill) {
+                    for (const std::string& line : lines) spool_->Append(line);
+                    spool_->Flush();
+                    lines.clear();
+                    continue;
+                }
+
+                // 连上时从暂存里按限速取一批
+                BackupSpool::Position spool_end;
+                if (!take && spool_unread && sock_ >= 0 && inflight_.size() < kMaxInFlight) {
+                    size_t allowance = kMaxBatchBytes;
+                    if (replay_rate_ > 0) {
+                        replay_tokens = std::min<double>(replay_rate_, replay_tokens + replay_rate_ *
+                            std::chrono::duration<double>(now - last_refill).count());
+                        last_refill = now;
+                        allowance = std::min(allowance, replay_rate_);
+                        if (replay_tokens < allowance) {
+                            deadline = std::min(deadline, now + std::chrono::duration_cast<clock::duration>(
+                                std::chrono::duration<double>((allowance - replay_tokens) / replay_rate_)));
+                            allowance = 0;
+                        }
+                    }
+                    if (allowance > 0) {
+                        replay_tokens -= spool_->Read(allowance, &lines, &spool_end);
+                        take = !lines.empty();
+                    }
+                }
+                if (take) {
+                    // 在锁外编码和压缩
+                    raw.clear();
+                    for (const std::string& line : lines) BackupProtocol::AppendRecord(line, &raw);
+                    Batch batch;
+                    batch.seq = next_seq_++;
+                    batch.records = static_cast<uint32_t>(lines.size());
+                    batch.raw_bytes = raw.size();
+                    BackupProtocol::EncodeBatch(batch.seq, batch.records, raw, &batch.frame);
+                    batch.from_spool = spool_end.segment != 0;
+                    batch.spool_end = spool_end;
+                    inflight_.push_back(std::move(batch));
+                    lines.clear();
+                    continue;
+                }
+
+                // 有数据要发时才建连接，建好后一直保持
+                if (sock_ < 0 && (!inflight_.empty() || spool_unread)) {
+                    if (now >= next_connect) {
+                        if (Connect()) {
+                            offline = false;
+                            backoff = kMinBackoff;
+                            send_index_ = 0;
+                            send_offset_ = 0;
+                            ack_buf_.clear();
+                        } else {
+                            offline = true;
+                            SpillInflight(false);
+                            next_connect = now + backoff;
+                            backoff = std::min(backoff * 2, kMaxBackoff);
+                        }
+                        continue;
+                    }
+                    deadline = std::min(deadline, next_connect);
+                }
+
+                struct pollfd fds[2] = {{wake_fd_, POLLIN, 0}, {sock_, POLLIN, 0}};
+                if (sock_ >= 0 && send_index_ < inflight_.size()) fds[1].events |= POLLOUT;
+                int timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                   deadline - clock::now()).count()) + 1;
+                if (poll(fds, sock_ >= 0 ? 2 : 1, std::max(timeout, 0)) <= 0) continue;
+                if (fds[0].revents & POLLIN) {
+                    uint64_t n;
+                    ssize_t ret = read(wake_fd_, &n, sizeof(n));
+                    (void)ret;
+                }
+                if (sock_ < 0) continue;
+                bool ok = true;
+                if (fds[1].revents & (POLLIN | POLLERR | POLLHUP)) ok = ReadAcks();
+                if (ok && (fds[1].revents & POLLOUT)) ok = SendPending();
+                if (!ok) {
+                    // 马上重连一次，失败再退避
+                    close(sock_);
+                    sock_ = -1;
+                    offline = true;
+                    SpillInflight(false);
+                    next_connect = clock::now();
+                }
+            }
+            SpillOnStop();
+        }
+
+        // 断开时把没确认的内存批次转存到暂存，由重放按顺序补发，内存里只留来自暂存的批次
+        // 内存批次只在暂存读空之后才会产生，只要暂存里还没有新记录，排到暂存末尾就不会打乱顺序；
+        // 否则(force 为 false 时)留在内存里等重连后重发
+        void SpillInflight(bool force)
+        {
+            if (spool_ == nullptr || (!force && spool_->HasUnread())) return;
+            std::deque<Batch> kept;
+            std::string raw;
+            for (Batch& batch : inflight_) {
+                if (batch.from_spool) {
+                    kept.push_back(std::move(batch));
+                    continue;
+                }
+                BackupProtocol::FrameHead head;
+                if (!BackupProtocol::DecodeHead(batch.frame.data(), &head) ||
+                    !BackupProtocol::DecodeBatch(head, batch.frame.data() + BackupProtocol::kHeadSize, &raw))
+                    continue;
+                BackupProtocol::ForEachRecord(head, raw, [this](const char* data, size_t len) {
+                    spool_->Append(std::string(data, len));
+                });
+            }
+            inflight_.swap(kept);
+            spool_->Flush();
+        }
+
+        // 退出前把剩下的都转存，下次启动时重放；来自暂存的批次 cursor 没推进，不用再存
+        // 这时在途的内存批次可能比暂存里已有的记录早，只能排到后面，顺序会有局部颠倒
+        void SpillOnStop()
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stopped_ = true;
+            if (spool_ == nullptr) return;
+            SpillInflight(true);
+            inflight_.clear();
+            for (const std::string& line : queue_) spool_->Append(line);
+            queue_.clear();
+            queued_bytes_ = 0;
+            spool_->Flush();
+        }
+
+        // 非阻塞连接加超时，目标主机不可达时不会卡住发送线程太久；连接保持非阻塞
+        bool Connect()
+        {
+            int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (sock < 0) {
+                std::cout << __FILE__ << __LINE__ << "socket error : " << strerror(errno) << std::endl;
+                return false;
+            }
+            struct sockaddr_in server;
+            memset(&server, 0, sizeof(server));
+            server.sin_family = AF_INET;
+            server.sin_port = htons(port_);
+            inet_aton(addr_.c_str(), &(server.sin_addr));
+
+            int ret = connect(sock, (struct sockaddr *)&server, sizeof(server));
+            if (ret < 0 && errno == EINPROGRESS) {
+                struct pollfd pfd = {sock, POLLOUT, 0};
+                int err = 0;
+                socklen_t len = sizeof(err);
+                if (poll(&pfd, 1, kConnectTimeoutMs) == 1 &&
+                    getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+                    ret = 0;
+                }
+            }
+            if (ret < 0) {
+                close(sock);
+                return false;
+            }
+            sock_ = sock;
+            std::lock_guard<std::mutex> lock(mtx_);
+            ++connects_;
+            return true;
+        }
+
+        // 按顺序发送还没发出去的批次，发不动了就等下一次可写
+        bool SendPending()
+        {
+            while (send_index_ < inflight_.size()) {
+                Batch& batch = inflight_[send_index_];
+                if (send_offset_ == 0 && batch.sent) {
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    ++resent_batches_;
+                }
+                ssize_t n = send(sock_, batch.frame.data() + send_offset_, batch.frame.size() - send_offset_,
+                                 MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+                    std::cout << __FILE__ << __LINE__ << "send to server error : " << strerror(errno) << std::endl;
+                    return false;
+                }
+                send_offset_ += n;
+                if (send_offset_ == batch.frame.size()) {
+                    batch.sent = true;
+                    ++send_index_;
+                    send_offset_ = 0;
+                }
+            }
+            return true;
+        }
+
+        // 读确认帧，确认是累计的：seq 及之前的在途批次都可以释放
+        bool ReadAcks()
+        {
+            char buf[4096];
+            while (true) {
+                ssize_t n = recv(sock_, buf, sizeof(buf), 0);
+                if (n > 0) {
+                    ack_buf_.append(buf, n);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                return false; // 对端关闭或出错
+            }
+            size_t pos = 0;
+            BackupSpool::Position committed;
+            while (ack_buf_.size() - pos >= BackupProtocol::kHeadSize) {
+                BackupProtocol::FrameHead head;
+                if (!BackupProtocol::DecodeHead(ack_buf_.data() + pos, &head) || head.type != BackupProtocol::kAck) {
+                    std::cout << __FILE__ << __LINE__ << "bad ack from backup server" << std::endl;
+                    return false;
+                }
+                pos += BackupProtocol::kHeadSize;
+                std::lock_guard<std::mutex> lock(mtx_);
+                while (!inflight_.empty() && inflight_.front().seq <= head.seq && inflight_.front().sent) {
+                    if (inflight_.front().from_spool) committed = inflight_.front().spool_end;
+                    acked_records_ += inflight_.front().records;
+                    acked_bytes_ += inflight_.front().raw_bytes;
+                    wire_bytes_ += inflight_.front().frame.size();
+                    ++acked_batches_;
+                    inflight_.pop_front();
+                    --send_index_;
+                }
+            }
+            ack_buf_.erase(0, pos);
+            if (committed.segment != 0) spool_->Commit(committed);
+            return true;
+        }
+
+    private:
+        const std::string addr_;
+        const uint16_t port_;
+        const size_t max_queue_bytes_;
+        const std::chrono::milliseconds batch_window_;
+        const size_t replay_rate_;
+        std::unique_ptr<BackupSpool> spool_;
+        int wake_fd_ = -1;
+
+        // 只有发送线程使用
+        int sock_ = -1;
+        uint64_t next_seq_ = 1;
+        std::deque<Batch> inflight_; // 已编码、还没确认的批次，按 seq 递增
+        size_t send_index_ = 0;      // 下一个要发的在途批次
+        size_t send_offset_ = 0;     // 它已经发出的字节数
+        std::string ack_buf_;
+
+        mutable std::mutex mtx_;
+        std::deque<std::string> queue_;
+        size_t queued_bytes_ = 0;
+        std::chrono::steady_clock::time_point first_enqueued_; // 队列里最早一条的入队时间
+        bool stop_ = false;
+        bool stopped_ = false; // 发送线程已退出
+        std::chrono::steady_clock::time_point stop_deadline_;
+
+        uint64_t acked_records_ = 0;
+        uint64_t acked_bytes_ = 0;
+        uint64_t wire_bytes_ = 0;
+        uint64_t acked_batches_ = 0;
+        uint64_t resent_batches_ = 0;
+        uint64_t connects_ = 0;
+        uint64_t dropped_ = 0;
+        std::thread thread_;
+    };
+} // namespace mylog
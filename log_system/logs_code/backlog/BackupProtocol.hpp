@@ -0,0 +1,168 @@
+#pragma once
+// 远程备份的传输格式，发送端(BackupClient.hpp)和接收端(ServerBackupLog.hpp)共用
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+#include <string>
+#include <zlib.h>
+
+namespace mylog
+{
+    // 每一帧都是定长帧头加负载，多字节字段都是网络字节序
+    //   magic(2) version(1) type(1) flags(1) 保留(3) seq(8) count(4) raw_len(4) payload_len(4) crc(4)
+    // 批次帧(kBatch)：负载是 count 条记录，每条是 uint32长度 + 一行格式化好的日志；
+    //   flags 带 kZlib 时负载是 zlib 压缩后的数据，raw_len 是解压后的长度；crc 是负载(按发送的字节)的 CRC32
+    // 确认帧(kAck)：没有负载，seq 表示这条连接上 seq 及之前的批次都已经写进接收端的文件
+    // seq 由发送端逐批递增，重连后没确认的批次按原 seq 重发，接收端可能收到重复的批次(至少一次)
+    namespace BackupProtocol
+    {
+        constexpr uint16_t kMagic = 0x4d42; // "MB"
+        constexpr uint8_t kVersion = 1;
+        constexpr size_t kHeadSize = 32;
+        constexpr uint32_t kMaxPayload = 64 * 1024 * 1024; // 超过的视为坏帧
+        constexpr size_t kCompressMin = 512;                // 负载小于这个不压缩
+
+        enum FrameType : uint8_t
+        {
+            kBatch = 1,
+            kAck = 2
+        };
+
+        enum Flags : uint8_t
+        {
+            kZlib = 1
+        };
+
+        struct FrameHead
+        {
+            uint8_t type = 0;
+            uint8_t flags = 0;
+            uint64_t seq = 0;
+            uint32_t count = 0;
+            uint32_t raw_len = 0;
+            uint32_t payload_len = 0;
+            uint32_t crc = 0;
+        };
+
+        inline void EncodeHead(const FrameHead& head, char* out)
+        {
+            uint16_t magic = htobe16(kMagic);
+            uint64_t seq = htobe64(head.seq);
+            uint32_t count = htobe32(head.count), raw_len = htobe32(head.raw_len),
+                     payload_len = htobe32(head.payload_len), crc = htobe32(head.crc);
+            memset(out, 0, kHeadSize);
+            memcpy(out, &magic, 2);
+            out[2] = static_cast<char>(kVersion);
+            out[3] = static_cast<char>(head.type);
+            out[4] = static_cast<char>(head.flags);
+            memcpy(out + 8, &seq, 8);
+            memcpy(out + 16, &count, 4);
+            memcpy(out + 20, &raw_len, 4);
+            memcpy(out + 24, &payload_len, 4);
+            memcpy(out + 28, &crc, 4);
+        }
+
+        // data 至少有 kHeadSize 字节；magic、版本或长度不对时返回 false
+        inline bool DecodeHead(const char* data, FrameHead* head)
+        {
+            uint16_t magic;
+            memcpy(&magic, data, 2);
+            if (be16toh(magic) != kMagic || static_cast<uint8_t>(data[2]) != kVersion) return false;
+            uint64_t seq;
+            uint32_t count, raw_len, payload_len, crc;
+            memcpy(&seq, data + 8, 8);
+            memcpy(&count, data + 16, 4);
+            memcpy(&raw_len, data + 20, 4);
+            memcpy(&payload_len, data + 24, 4);
+            memcpy(&crc, data + 28, 4);
+            head->type = static_cast<uint8_t>(data[3]);
+            head->flags = static_cast<uint8_t>(data[4]);
+            head->seq = be64toh(seq);
+            head->count = be32toh(count);
+            head->raw_len = be32toh(raw_len);
+            head->payload_len = be32toh(payload_len);
+            head->crc = be32toh(crc);
+            return head->payload_len <= kMaxPayload && head->raw_len <= kMaxPayload;
+        }
+
+        // 往批次负载里追加一条记录
+        inline void AppendRecord(const std::string& record, std::string* raw)
+        {
+            uint32_t len = htobe32(static_cast<uint32_t>(record.size()));
+            raw->append(reinterpret_cast<const char*>(&len), 4);
+            raw->append(record);
+        }
+
+        // 把攒好的记录编码成一个完整的批次帧，压缩后更小才用压缩的负载
+        inline void EncodeBatch(uint64_t seq, uint32_t count, const std::string& raw, std::string* out)
+        {
+            FrameHead head;
+            head.type = kBatch;
+            head.seq = seq;
+            head.count = count;
+            head.raw_len = static_cast<uint32_t>(raw.size());
+            out->resize(kHeadSize);
+            if (raw.size() >= kCompressMin) {
+                uLongf bound = compressBound(raw.size());
+                out->resize(kHeadSize + bound);
+                if (compress2(reinterpret_cast<Bytef*>(&(*out)[kHeadSize]), &bound,
+                              reinterpret_cast<const Bytef*>(raw.data()), raw.size(), 1) == Z_OK &&
+                    bound < raw.size()) {
+                    head.flags = kZlib;
+                    out->resize(kHeadSize + bound);
+                } else {
+                    out->resize(kHeadSize);
+                }
+            }
+            if (head.flags != kZlib) out->append(raw);
+            head.payload_len = static_cast<uint32_t>(out->size() - kHeadSize);
+            head.crc = crc32(0L, reinterpret_cast<const Bytef*>(out->data() + kHeadSize), head.payload_len);
+            EncodeHead(head, &(*out)[0]);
+        }
+
+        inline void EncodeAck(uint64_t seq, std::string* out)
+        {
+            FrameHead head;
+            head.type = kAck;
+            head.seq = seq;
+            char buf[kHeadSize];
+            EncodeHead(head, buf);
+            out->append(buf, kHeadSize);
+        }
+
+        // 校验并还原批次负载，得到未压缩的记录序列
+        inline bool DecodeBatch(const FrameHead& head, const char* payload, std::string* raw)
+        {
+            if (crc32(0L, reinterpret_cast<const Bytef*>(payload), head.payload_len) != head.crc) return false;
+            if (head.flags & kZlib) {
+                raw->resize(head.raw_len);
+                uLongf len = head.raw_len;
+                if (uncompress(reinterpret_cast<Bytef*>(&(*raw)[0]), &len,
+                               reinterpret_cast<const Bytef*>(payload), head.payload_len) != Z_OK ||
+                    len != head.raw_len)
+                    return false;
+            } else {
+                raw->assign(payload, head.payload_len);
+            }
+            return true;
+        }
+
+        // 依次取出负载里的记录，记录数或长度对不上时返回 false
+        template <typename Fn>
+        bool ForEachRecord(const FrameHead& head, const std::string& raw, Fn fn)
+        {
+            size_t pos = 0;
+            for (uint32_t i = 0; i < head.count; ++i) {
+                uint32_t len;
+                if (raw.size() - pos < 4) return false;
+                memcpy(&len, raw.data() + pos, 4);
+                len = be32toh(len);
+                pos += 4;
+                if (raw.size() - pos < len) return false;
+                fn(raw.data() + pos, len);
+                pos += len;
+            }
+            return pos == raw.size();
+        }
+    } // namespace BackupProtocol
+} // namespace mylog
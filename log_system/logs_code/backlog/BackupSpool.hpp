@@ -0,0 +1,308 @@
+#pragma once
+// 备份发送端的磁盘暂存：接收端连不上或跟不上时，待发的日志先追加到本地分段文件里，恢复后按顺序重放
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../Util.hpp"
+
+namespace mylog
+{
+    // 文件布局，path 为配置的前缀：
+    //   path.00000001 path.00000002 ...  只追加的分段，每条记录是 uint32长度(网络字节序) + 一行日志
+    //   path.cursor                      已被接收端确认的位置 "分段号 偏移"，先写临时文件再改名
+    // 读位置只在内存里，重放出去还没确认的记录在进程重启后会从 cursor 再发一次(至少一次)
+    // 完全确认过的分段删除；所有分段的总大小超过上限时新记录丢弃
+    class BackupSpool
+    {
+    public:
+        struct Position
+        {
+            uint64_t segment = 0;
+            uint64_t offset = 0;
+        };
+
+        BackupSpool(const std::string& path, size_t max_bytes)
+            : path_(path), max_bytes_(max_bytes),
+              segment_bytes_(std::max<size_t>(std::min<size_t>(kSegmentBytes, max_bytes / 4), 64 * 1024))
+        {
+            Util::File::CreateDirectory(Util::File::Path(path_));
+            Recover();
+        }
+
+        ~BackupSpool()
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            FlushLocked();
+            if (write_fd_ != -1) close(write_fd_);
+            if (read_fd_ != -1) close(read_fd_);
+        }
+
+        BackupSpool(const BackupSpool&) = delete;
+        BackupSpool& operator=(const BackupSpool&) = delete;
+
+        // 追加到写缓冲，Flush 或下一次读时才写进文件；超过总大小上限时丢弃并返回 false
+        bool Append(const std::string& record)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            size_t size = 4 + record.size();
+            if (total_bytes_ + pending_.size() + size > max_bytes_) {
+                ++dropped_;
+                return false;
+            }
+            uint32_t len = htobe32(static_cast<uint32_t>(record.size()));
+            pending_.append(reinterpret_cast<const char*>(&len), 4);
+            pending_.append(record);
+            return true;
+        }
+
+        void Flush()
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            FlushLocked();
+        }
+
+        // 还有没读出去的记录
+        bool HasUnread() const
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return !pending_.empty() || Before(read_, write_);
+        }
+
+        // 从读位置起读出不超过 max_bytes 的整条记录(至少一条)，end 是读完后的位置，交给 Commit
+        size_t Read(size_t max_bytes, std::vector<std::string>* records, Position* end)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            FlushLocked();
+            size_t bytes = 0;
+            while (Before(read_, write_) && (bytes == 0 || bytes < max_bytes)) {
+                if (!OpenRead()) break;
+                uint32_t len;
+                if (pread(read_fd_, &len, 4, read_.offset) != 4) {
+                    NextReadSegment(); // 这个分段读完了(或末尾不完整)
+                    continue;
+                }
+                len = be32toh(len);
+                std::string record(len, '\0');
+                if (len > 0 && pread(read_fd_, &record[0], len, read_.offset + 4) != static_cast<ssize_t>(len)) {
+                    NextReadSegment();
+                    continue;
+                }
+                read_.offset += 4 + len;
+                bytes += len;
+                records->push_back(std::move(record));
+            }
+            *end = read_;
+            return bytes;
+        }
+
+        // 接收端确认到 pos：持久化 cursor，删掉之前完全确认过的分段
+        // cursor 总是先落盘再截断或删除分段，中途崩溃最多重发已确认的记录，不会跳过没确认的
+        void Commit(const Position& pos)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (!Before(cursor_, pos)) return;
+            cursor_ = pos;
+            if (pending_.empty() && cursor_.segment == write_.segment && cursor_.offset == write_.offset &&
+                SaveCursor(Position{cursor_.segment, 0})) {
+                // 全部确认完，当前分段清空重用
+                if (ftruncate(write_fd_, 0) == 0) {
+                    total_bytes_ -= segments_[write_.segment];
+                    segments_[write_.segment] = 0;
+                    write_.offset = read_.offset = cursor_.offset = 0;
+                } else {
+                    SaveCursor(cursor_);
+                }
+            } else if (!SaveCursor(cursor_)) {
+                return;
+            }
+            while (!segments_.empty() && segments_.begin()->first < cursor_.segment) {
+                unlink(SegmentName(segments_.begin()->first).c_str());
+                total_bytes_ -= segments_.begin()->second;
+                segments_.erase(segments_.begin());
+            }
+        }
+
+        std::string Report() const
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            char buf[160];
+            snprintf(buf, sizeof(buf), "spool: %zu bytes in %zu segments, %llu dropped",
+                     total_bytes_ + pending_.size(), segments_.size(), static_cast<unsigned long long>(dropped_));
+            return buf;
+        }
+
+    private:
+        static constexpr size_t kSegmentBytes = 16 * 1024 * 1024;
+
+        static bool Before(const Position& a, const Position& b)
+        {
+            return a.segment < b.segment || (a.segment == b.segment && a.offset < b.offset);
+        }
+
+        std::string SegmentName(uint64_t segment) const
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), ".%08" PRIu64, segment);
+            return path_ + buf;
+        }
+
+        // 先写临时文件再改名，cursor 文件要么是旧值要么是新值
+        bool SaveCursor(const Position& pos)
+        {
+            std::string tmp = path_ + ".cursor.tmp";
+            FILE* fp = fopen(tmp.c_str(), "w");
+            if (fp == NULL) {
+                std::cout << __FILE__ << __LINE__ << "open " << tmp << " failed: " << strerror(errno) << std::endl;
+                return false;
+            }
+            fprintf(fp, "%" PRIu64 " %" PRIu64 "\n", pos.segment, pos.offset);
+            if (fclose(fp) != 0) return false;
+            return rename(tmp.c_str(), (path_ + ".cursor").c_str()) == 0;
+        }
+
+        // 找出已有的分段和 cursor，截掉最后一个分段末尾写了一半的记录，从那里接着追加
+        void Recover()
+        {
+            std::string dir = Util::File::Path(path_);
+            std::string prefix = path_.substr(dir.size()) + ".";
+            DIR* d = opendir(dir.empty() ? "./" : dir.c_str());
+            if (d != NULL) {
+                while (struct dirent* entry = readdir(d)) {
+                    std::string name = entry->d_name;
+                    if (name.size() != prefix.size() + 8 || name.compare(0, prefix.size(), prefix) != 0) continue;
+                    char* endp;
+                    uint64_t segment = strtoull(name.c_str() + prefix.size(), &endp, 10);
+                    if (*endp != '\0' || segment == 0) continue;
+                    struct stat st;
+                    if (stat(SegmentName(segment).c_str(), &st) == 0) segments_[segment] = st.st_size;
+                }
+                closedir(d);
+            }
+            FILE* fp = fopen((path_ + ".cursor").c_str(), "r");
+            if (fp != NULL) {
+                if (fscanf(fp, "%" SCNu64 " %" SCNu64, &cursor_.segment, &cursor_.offset) != 2) cursor_ = Position();
+                fclose(fp);
+            }
+            while (!segments_.empty() && segments_.begin()->first < cursor_.segment) {
+                unlink(SegmentName(segments_.begin()->first).c_str());
+                segments_.erase(segments_.begin());
+            }
+            if (segments_.empty()) {
+                segments_[std::max<uint64_t>(cursor_.segment, 1)] = 0;
+            } else {
+                auto last = std::prev(segments_.end());
+                last->second = ValidLength(last->first, last->second);
+                truncate(SegmentName(last->first).c_str(), last->second);
+            }
+            for (const auto& seg : segments_) total_bytes_ += seg.second;
+            if (cursor_.segment < segments_.begin()->first) cursor_ = Position{segments_.begin()->first, 0};
+            // 分段比 cursor 记的短(末尾被截掉或旧版本先截断后写 cursor)时，从分段末尾接着读
+            auto cur = segments_.find(cursor_.segment);
+            if (cur != segments_.end() && cursor_.offset > cur->second) cursor_.offset = cur->second;
+            read_ = cursor_;
+            auto last = std::prev(segments_.end());
+            write_ = Position{last->first, last->second};
+            write_fd_ = open(SegmentName(write_.segment).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (write_fd_ == -1) {
+                std::cout << __FILE__ << __LINE__ << "open spool " << SegmentName(write_.segment)
+                          << " failed: " << strerror(errno) << std::endl;
+            }
+        }
+
+        // 分段开头连续完整记录的长度
+        uint64_t ValidLength(uint64_t segment, uint64_t size) const
+        {
+            int fd = open(SegmentName(segment).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) return 0;
+            uint64_t off = 0;
+            uint32_t len;
+            while (off + 4 <= size && pread(fd, &len, 4, off) == 4 && off + 4 + be32toh(len) <= size) {
+                off += 4 + be32toh(len);
+            }
+            close(fd);
+            return off;
+        }
+
+        void FlushLocked()
+        {
+            if (pending_.empty() || write_fd_ == -1) return;
+            size_t off = 0;
+            while (off < pending_.size()) {
+                ssize_t n = write(write_fd_, pending_.data() + off, pending_.size() - off);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    std::cout << __FILE__ << __LINE__ << "write spool failed: " << strerror(errno) << std::endl;
+                    break;
+                }
+                off += n;
+            }
+            write_.offset += off;
+            segments_[write_.segment] += off;
+            total_bytes_ += off;
+            pending_.clear();
+            if (write_.offset >= segment_bytes_) {
+                // 记录不跨分段，写满一批后换新分段
+                close(write_fd_);
+                write_ = Position{write_.segment + 1, 0};
+                segments_[write_.segment] = 0;
+                write_fd_ = open(SegmentName(write_.segment).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            }
+        }
+
+        bool OpenRead()
+        {
+            if (read_fd_ != -1 && read_fd_segment_ == read_.segment) return true;
+            if (read_fd_ != -1) close(read_fd_);
+            read_fd_ = open(SegmentName(read_.segment).c_str(), O_RDONLY | O_CLOEXEC);
+            read_fd_segment_ = read_.segment;
+            if (read_fd_ == -1) {
+                // 分段被外部删掉了，跳过
+                if (read_.segment < write_.segment) {
+                    read_ = Position{read_.segment + 1, 0};
+                    return OpenRead();
+                }
+                return false;
+            }
+            return true;
+        }
+
+        void NextReadSegment()
+        {
+            if (read_.segment < write_.segment) {
+                read_ = Position{read_.segment + 1, 0};
+            } else {
+                read_ = write_; // 当前分段末尾不完整，不应出现，放弃剩下的
+            }
+        }
+
+    private:
+        const std::string path_;
+        const size_t max_bytes_;
+        const size_t segment_bytes_;
+
+        mutable std::mutex mtx_;
+        std::map<uint64_t, uint64_t> segments_; // 分段号 -> 文件大小
+        size_t total_bytes_ = 0;
+        std::string pending_; // 还没写进文件的记录
+        Position write_;      // 下一条记录写到哪里
+        Position read_;       // 下一条要读出的记录
+        Position cursor_;     // 接收端已确认到哪里
+        int write_fd_ = -1;
+        int read_fd_ = -1;
+        uint64_t read_fd_segment_ = 0;
+        uint64_t dropped_ = 0;
+    };
+} // namespace mylog
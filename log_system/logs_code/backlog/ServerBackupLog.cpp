@@ -1,49 +1,36 @@
 // 远程备份debug等级以上的日志信息-接收端
 #include <string>
-#include <cassert>
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
 #include <unistd.h>
 #include <memory>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
+#include <signal.h>
 #include "ServerBackupLog.hpp"
 using std::cout;
 using std::endl;
 const std::string filename = "./logfile.log";
 void usage(std::string procgress)
 {
-    cout << "usage error:" << procgress << "port" << endl;
+    cout << "usage error:" << procgress << " port [workers]" << endl;
 }
-bool file_exist(const std::string &name)
+
+std::unique_ptr<BackupFileWriter> writer;
+std::unique_ptr<TcpServer> tcp;
+
+uint64_t backup_log(const std::string &message)//用作回调
 {
-    struct stat exist;
-    return (stat(name.c_str(), &exist) == 0);
+    return writer->Append(message);
 }
 
-void backup_log(const std::string &message)//用作回调
+void handle_stop(int)
 {
-    FILE *fp = fopen(filename.c_str(), "ab");
-    if (fp == NULL)
-    {
-        perror("fopen error: ");
-        assert(false);
-    }
-    int write_byte = fwrite(message.c_str(), 1, message.size(), fp);
-    if (write_byte != message.size())
-    {
-        perror("fwrite error: ");
-        assert(false);
-    }
-    fflush(fp);
-    fclose(fp);
+    tcp->stop();
 }
+
 int main(int args, char *argv[])
 {
-    if (args != 2)
+    if (args != 2 && args != 3)
     {
         usage(argv[0]);
         perror("usage error");
@@ -51,10 +38,23 @@ int main(int args, char *argv[])
     }
 
     uint16_t port = atoi(argv[1]);
-    std::unique_ptr<TcpServer> tcp(new TcpServer(port, backup_log));
+    size_t workers = args == 3 ? atoi(argv[2]) : 2;
+    writer.reset(new BackupFileWriter(filename));
+    tcp.reset(new TcpServer(port, backup_log, workers));
+    writer->set_flush_callback([](uint64_t flushed) { tcp->notify_flushed(flushed); });
+
+    // 收到 SIGINT/SIGTERM 时停止接收，析构时把缓冲区里的日志写完
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
 
     tcp->init_service();
     tcp->start_service();
 
+    writer.reset(); // 最后一次落盘还会通知 tcp
+    tcp.reset();
     return 0;
-}
\ No newline at end of file
+}
@@ -5,51 +5,155 @@
 #include <cstring>
 #include <cerrno>
 #include <cstdlib>
-#include <pthread.h>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <functional>
 
+#include "BackupProtocol.hpp"
+
 using std::cout;
 using std::endl;
 
-using func_t = std::function<void(const std::string &)>;
+// 回调收到的是一条或多条完整的日志行，每行都带上了客户端地址前缀
+// 返回一个递增的凭据，落盘进度越过它之后(TcpServer::notify_flushed)这些日志所属的批次才会被确认
+using func_t = std::function<uint64_t(const std::string &)>;
 const int backlog = 32;
 
-class TcpServer;
-//该类包含客户端的ip和端口信息
-class ThreadData
+// 所有连接共用的落盘器：回调只把数据追加进内存缓冲区，
+// 一个长期打开文件的写线程每隔 flush_interval 或攒够 flush_bytes 就整块写出并 fflush 一次
+class BackupFileWriter
 {
 public:
-    ThreadData(int fd, const std::string &ip, const uint16_t &port, TcpServer *ts)
-        : sock(fd),client_ip(ip),client_port(port),ts_(ts){}
+    BackupFileWriter(const std::string &filename,
+                     std::chrono::milliseconds flush_interval = std::chrono::milliseconds(50),
+                     size_t flush_bytes = 1024 * 1024, size_t max_bytes = 64 * 1024 * 1024)
+        : flush_interval_(flush_interval), flush_bytes_(flush_bytes), max_bytes_(max_bytes)
+    {
+        fp_ = fopen(filename.c_str(), "ab");
+        if (fp_ == NULL){
+            std::cout << __FILE__ << __LINE__ << "open " << filename << " failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        thread_ = std::thread(&BackupFileWriter::WriterThreadEntry, this);
+    }
+    ~BackupFileWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        if (thread_.joinable())
+            thread_.join();
+        if (fp_ != NULL)
+            fclose(fp_);
+    }
+    BackupFileWriter(const BackupFileWriter &) = delete;
+    BackupFileWriter &operator=(const BackupFileWriter &) = delete;
 
-public:
-    int sock;
-    std::string client_ip;
-    uint16_t client_port;
-    TcpServer *ts_;
+    // 每次 fflush 之后调用，参数是已经写进文件的累计字节数，要在开始接收之前设置
+    void set_flush_callback(std::function<void(uint64_t)> cb)
+    {
+        flush_cb_ = std::move(cb);
+    }
+
+    // 写线程落后太多时阻塞调用的工作线程，压力通过 TCP 反传给发送端
+    // 返回追加之后的累计字节数，落盘进度达到它时这段数据就已经写进文件
+    uint64_t Append(const std::string &data)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_space_.wait(lock, [&] { return stop_ || buffer_.size() < max_bytes_; });
+        buffer_ += data;
+        appended_ += data.size();
+        if (buffer_.size() >= flush_bytes_)
+            cond_.notify_one();
+        return appended_;
+    }
+
+private:
+    void WriterThreadEntry()
+    {
+        std::string writing;
+        std::unique_lock<std::mutex> lock(mtx_);
+        while (true)
+        {
+            cond_.wait_for(lock, flush_interval_, [this] { return stop_ || buffer_.size() >= flush_bytes_; });
+            if (buffer_.empty()){
+                if (stop_) break;
+                continue;
+            }
+            writing.swap(buffer_); // 交换缓冲区，写盘时不挡住工作线程
+            uint64_t end = appended_;
+            lock.unlock();
+            cond_space_.notify_all();
+            bool ok = fwrite(writing.data(), 1, writing.size(), fp_) == writing.size();
+            ok = fflush(fp_) == 0 && ok;
+            if (!ok){
+                perror("fwrite error: ");
+                failed_ = true; // 之后的进度不能说明之前的数据已经写进文件，不再确认
+            }else if (flush_cb_ && !failed_){
+                flush_cb_(end);
+            }
+            writing.clear();
+            lock.lock();
+        }
+    }
+
+private:
+    FILE *fp_ = NULL;
+    const std::chrono::milliseconds flush_interval_;
+    const size_t flush_bytes_;
+    const size_t max_bytes_;
+
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::condition_variable cond_space_;
+    std::string buffer_;
+    uint64_t appended_ = 0;
+    bool stop_ = false;
+    bool failed_ = false; // 只有写线程使用
+    std::function<void(uint64_t)> flush_cb_;
+    std::thread thread_;
 };
 
+
+// 接收端：accept 线程接收连接后按轮转交给固定数量的工作线程，
+// 每个工作线程用自己的 epoll(边沿触发)处理名下所有连接，读出完整的批次帧(见 BackupProtocol.hpp)，
+// 校验解压后把记录交给回调；落盘进度越过批次的凭据后，按 seq 回确认帧
 class TcpServer
 {
 public:
-    TcpServer(uint16_t port, func_t func)
-        : port_(port), func_(func)
+    TcpServer(uint16_t port, func_t func, size_t workers = 2)
+        : port_(port), func_(func), workers_(workers == 0 ? 1 : workers)
     {
     }
     void init_service()
     {
         // 创建
-        listen_sock_ = socket(AF_INET, SOCK_STREAM, 0);
+        listen_sock_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
         if (listen_sock_ == -1){
             std::cout << __FILE__ << __LINE__ <<"create socket error"<< strerror(errno)<< std::endl;
         }
 
+        // 重启后立刻复用端口，不等旧连接的 TIME_WAIT
+        int opt = 1;
+        setsockopt(listen_sock_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
         struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
         local.sin_family = AF_INET;
         local.sin_port = htons(port_);
         local.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -61,29 +165,40 @@ public:
         if (listen(listen_sock_, backlog) < 0) {
             std::cout << __FILE__ << __LINE__ <<  "listen error"<< strerror(errno)<< std::endl;
         }
-    }
 
-    static void *threadRoutine(void *args)
-    {
-        pthread_detach(pthread_self()); // 防止在start_service处阻塞
-
-        ThreadData *td = static_cast<ThreadData *>(args);
-        std::string client_info = td->client_ip + ":" + std::to_string(td->client_port);
-        td->ts_->service(td->sock,move(client_info));
-        close(td->sock);
-        delete td;
-        return nullptr;
+        for (size_t i = 0; i < workers_.size(); ++i)
+        {
+            Worker &w = workers_[i];
+            w.epfd = epoll_create1(EPOLL_CLOEXEC);
+            w.flush_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (w.epfd == -1 || w.flush_fd == -1){
+                std::cout << __FILE__ << __LINE__ << "epoll_create error" << strerror(errno) << std::endl;
+                continue;
+            }
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLET;
+            ev.data.ptr = nullptr; // 落盘进度通知
+            epoll_ctl(w.epfd, EPOLL_CTL_ADD, w.flush_fd, &ev);
+        }
     }
 
+    // 阻塞在当前线程接收连接，直到 stop()
     void start_service()
     {
-        while (true)
+        for (auto &w : workers_)
+            w.thread = std::thread(&TcpServer::WorkerThreadEntry, this, &w);
+
+        size_t next = 0;
+        while (!stop_.load(std::memory_order_relaxed))
         {
             struct sockaddr_in client_addr;
             socklen_t client_addrlen = sizeof(client_addr);
-            int connfd = accept(listen_sock_, (struct sockaddr *)&client_addr, &client_addrlen);
+            int connfd = accept4(listen_sock_, (struct sockaddr *)&client_addr, &client_addrlen,
+                                 SOCK_NONBLOCK | SOCK_CLOEXEC);
             if (connfd < 0){
-                std::cout << __FILE__ << __LINE__ << "accept error"<< strerror(errno)<< std::endl;
+                if (stop_.load(std::memory_order_relaxed)) break;
+                if (errno != EINTR && errno != ECONNABORTED)
+                    std::cout << __FILE__ << __LINE__ << "accept error"<< strerror(errno)<< std::endl;
                 continue;
             }
 
@@ -91,32 +206,264 @@ public:
             std::string client_ip = inet_ntoa(client_addr.sin_addr); // 网络序列转字符串
             uint16_t client_port = ntohs(client_addr.sin_port);
 
-            // 多个线程提供服务
-            // 传入线程数据类型来访问threadRoutine，因为该函数是static的，所以内部传入了data类型存了tcpserver类型
-            pthread_t tid;
-            ThreadData *td = new ThreadData(connfd, client_ip, client_port, this);
-            pthread_create(&tid, nullptr, threadRoutine, td);
+            // 连接交给工作线程后只由它访问，关闭时由它释放
+            Connection *conn = new Connection;
+            conn->sock = connfd;
+            conn->client_info = client_ip + ":" + std::to_string(client_port);
+            Worker &w = workers_[next++ % workers_.size()];
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET; // EPOLLOUT 用于发完积压的确认帧
+            ev.data.ptr = conn;
+            if (epoll_ctl(w.epfd, EPOLL_CTL_ADD, connfd, &ev) == -1){
+                std::cout << __FILE__ << __LINE__ << "epoll_ctl error" << strerror(errno) << std::endl;
+                close(connfd);
+                delete conn;
+            }
+        }
+
+        for (auto &w : workers_)
+            w.thread.join();
+    }
+
+    // 可以在信号处理函数里调用：让 accept 返回，工作线程在下一次超时醒来时退出
+    void stop()
+    {
+        stop_.store(true, std::memory_order_relaxed);
+        shutdown(listen_sock_, SHUT_RDWR);
+    }
+
+    // 落盘器每次 fflush 后调用，唤醒各工作线程发确认
+    void notify_flushed(uint64_t flushed)
+    {
+        flushed_.store(flushed, std::memory_order_release);
+        uint64_t one = 1;
+        for (auto &w : workers_)
+        {
+            ssize_t ret = write(w.flush_fd, &one, sizeof(one));
+            (void)ret;
+        }
+    }
+
+    ~TcpServer()
+    {
+        for (auto &w : workers_)
+        {
+            if (w.epfd != -1) close(w.epfd);
+            if (w.flush_fd != -1) close(w.flush_fd);
         }
+        close(listen_sock_);
     }
 
-    void service(int sock,const std::string&& client_info)
+private:
+    static constexpr int kMaxEvents = 64;
+    static constexpr int kWaitTimeoutMs = 200;
+    static constexpr size_t kReadBufferSize = 64 * 1024;
+    static constexpr size_t kTurnBytes = 1024 * 1024;
+
+    struct PendingAck
+    {
+        uint64_t ticket; // 落盘进度达到它之后
+        uint64_t seq;    // 确认到这个批次
+    };
+
+    struct Connection
+    {
+        int sock = -1;
+        std::string client_info;
+        std::string inbuf;                // 还没凑成完整帧的数据
+        std::deque<PendingAck> acks;      // 等待落盘的批次，ticket 递增
+        std::string outbuf;               // 没发完的确认帧
+        bool ready = false;               // 已在工作线程的待读列表里
+        bool awaiting = false;            // 已在工作线程的待确认列表里
+    };
+
+    struct Worker
     {
-        char buf[1024];
+        int epfd = -1;
+        int flush_fd = -1;
+        std::thread thread;
+    };
 
-        int r_ret = read(sock, buf, sizeof(buf));
-        if(r_ret ==-1){
-            std::cout << __FILE__ << __LINE__ <<"read error"<< strerror(errno)<< std::endl;
-            perror("NULL");
-        }else if(r_ret > 0){
-            buf[r_ret] = 0;
-            std::string tmp = buf;
-            func_(client_info+tmp); // 进行回调
+    enum class ReadResult
+    {
+        DRAINED, // 读到了 EAGAIN，等下一次通知
+        MORE,    // 本轮额度用完，还有数据
+        CLOSED
+    };
+
+    void WorkerThreadEntry(Worker *w)
+    {
+        struct epoll_event events[kMaxEvents];
+        std::vector<char> buf(kReadBufferSize);
+        std::string out, raw;
+        std::vector<Connection *> ready, still_ready; // 上一轮没读到 EAGAIN 的连接，不会再有新通知
+        std::vector<Connection *> awaiting;           // 有批次等待落盘确认的连接
+        while (!stop_.load(std::memory_order_relaxed))
+        {
+            int n = epoll_wait(w->epfd, events, kMaxEvents, ready.empty() ? kWaitTimeoutMs : 0);
+            if (n == -1 && errno != EINTR){
+                std::cout << __FILE__ << __LINE__ << "epoll_wait error" << strerror(errno) << std::endl;
+                break;
+            }
+            bool flushed = false;
+            for (int i = 0; i < n; ++i)
+            {
+                Connection *conn = static_cast<Connection *>(events[i].data.ptr);
+                if (conn == nullptr){
+                    uint64_t cnt;
+                    ssize_t ret = read(w->flush_fd, &cnt, sizeof(cnt));
+                    (void)ret;
+                    flushed = true;
+                }else if (!conn->ready){
+                    conn->ready = true;
+                    ready.push_back(conn);
+                }
+            }
+            // 每个连接一轮最多读 kTurnBytes，一个发得很快的连接不会饿死同一线程上的其它连接
+            still_ready.clear();
+            for (Connection *conn : ready)
+            {
+                ReadResult r = service(conn, buf, out, raw);
+                if (r != ReadResult::CLOSED && !SendAcks(conn))
+                    r = ReadResult::CLOSED;
+                if (r == ReadResult::MORE){
+                    still_ready.push_back(conn);
+                }else if (r == ReadResult::CLOSED){
+                    Close(conn, awaiting);
+                    continue;
+                }else{
+                    conn->ready = false;
+                }
+                // 先登记再等通知：登记之前已经发生的落盘在上面的 SendAcks 里已经看到了
+                if (!conn->acks.empty() && !conn->awaiting){
+                    conn->awaiting = true;
+                    awaiting.push_back(conn);
+                }
+            }
+            ready.swap(still_ready);
+
+            if (flushed)
+            {
+                size_t kept = 0;
+                for (Connection *conn : awaiting)
+                {
+                    // 发送失败时连接可能还在待读列表里，这里不释放，关掉后由读到的错误走正常的关闭流程
+                    if (!SendAcks(conn)){
+                        shutdown(conn->sock, SHUT_RDWR);
+                        conn->acks.clear();
+                        conn->outbuf.clear();
+                    }
+                    if (conn->acks.empty() && conn->outbuf.empty())
+                        conn->awaiting = false;
+                    else
+                        awaiting[kept++] = conn;
+                }
+                awaiting.resize(kept);
+            }
         }
+        // 停止时还开着的连接不再处理，进程随后退出；没确认的批次发送端会重发
+    }
+
+    void Close(Connection *conn, std::vector<Connection *> &awaiting)
+    {
+        if (conn->awaiting)
+            awaiting.erase(std::find(awaiting.begin(), awaiting.end(), conn));
+        close(conn->sock); // 关闭时自动从 epoll 中移除
+        delete conn;
+    }
+
+    // 边沿触发，必须一直读到 EAGAIN，否则要自己记着下一轮接着读
+    ReadResult service(Connection *conn, std::vector<char> &buf, std::string &out, std::string &raw)
+    {
+        ReadResult result = ReadResult::MORE;
+        size_t turn = 0;
+        while (turn < kTurnBytes)
+        {
+            ssize_t r_ret = read(conn->sock, buf.data(), buf.size());
+            if (r_ret > 0){
+                conn->inbuf.append(buf.data(), r_ret);
+                turn += r_ret;
+                continue;
+            }
+            if (r_ret == -1 && errno == EINTR) continue;
+            if (r_ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                result = ReadResult::DRAINED;
+                break;
+            }
+            if (r_ret == -1)
+                std::cout << __FILE__ << __LINE__ <<"read error"<< strerror(errno)<< std::endl;
+            result = ReadResult::CLOSED; // 对端关闭或出错，不完整的帧丢掉，发送端没收到确认会重发
+            break;
+        }
+
+        // 取出所有完整的批次帧
+        out.clear();
+        uint64_t last_seq = 0;
+        size_t pos = 0;
+        while (conn->inbuf.size() - pos >= mylog::BackupProtocol::kHeadSize)
+        {
+            mylog::BackupProtocol::FrameHead head;
+            if (!mylog::BackupProtocol::DecodeHead(conn->inbuf.data() + pos, &head) ||
+                head.type != mylog::BackupProtocol::kBatch){
+                std::cout << __FILE__ << __LINE__ << conn->client_info << " bad frame head" << std::endl;
+                return ReadResult::CLOSED;
+            }
+            if (conn->inbuf.size() - pos - mylog::BackupProtocol::kHeadSize < head.payload_len)
+                break;
+            const char *payload = conn->inbuf.data() + pos + mylog::BackupProtocol::kHeadSize;
+            bool ok = mylog::BackupProtocol::DecodeBatch(head, payload, &raw) &&
+                      mylog::BackupProtocol::ForEachRecord(head, raw, [&](const char *data, size_t len) {
+                          out += conn->client_info;
+                          out.append(data, len);
+                          if (len == 0 || data[len - 1] != '\n')
+                              out += '\n';
+                      });
+            if (!ok){
+                // 校验失败的批次不确认，断开后发送端会重发
+                std::cout << __FILE__ << __LINE__ << conn->client_info << " corrupt batch " << head.seq << std::endl;
+                return ReadResult::CLOSED;
+            }
+            last_seq = head.seq;
+            pos += mylog::BackupProtocol::kHeadSize + head.payload_len;
+        }
+        conn->inbuf.erase(0, pos);
+        if (last_seq != 0){
+            uint64_t ticket = func_(out); // 本轮收齐的所有批次合成一次回调
+            conn->acks.push_back(PendingAck{ticket, last_seq});
+        }
+        return result;
+    }
+
+    // 发出落盘进度已经越过的确认(只发最新的一个，确认是累计的)，以及上次没发完的部分
+    bool SendAcks(Connection *conn)
+    {
+        uint64_t flushed = flushed_.load(std::memory_order_acquire);
+        uint64_t seq = 0;
+        while (!conn->acks.empty() && conn->acks.front().ticket <= flushed)
+        {
+            seq = conn->acks.front().seq;
+            conn->acks.pop_front();
+        }
+        if (seq != 0)
+            mylog::BackupProtocol::EncodeAck(seq, &conn->outbuf);
+        while (!conn->outbuf.empty())
+        {
+            ssize_t n = send(conn->sock, conn->outbuf.data(), conn->outbuf.size(), MSG_NOSIGNAL);
+            if (n < 0){
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break; // 等 EPOLLOUT
+                return false;
+            }
+            conn->outbuf.erase(0, n);
+        }
+        return true;
     }
-    ~TcpServer()=default;
 
 private:
-    int listen_sock_;
+    int listen_sock_ = -1;
     uint16_t port_;
     func_t func_;
-};
\ No newline at end of file
+    std::vector<Worker> workers_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> flushed_{0};
+};
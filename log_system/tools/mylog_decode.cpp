@@ -0,0 +1,203 @@
+// 把二进制模式的日志文件解码成文本，格式和文本模式的日志器一致
+// 用法: mylog_decode [-p pattern] [-j] file...   -j 把结构化日志输出成 JSON 行
+// 滚动产生的每个分段开头都有文件头和完整的调用点表，可以单独解码；多个文件按生成顺序传入即可连起来看
+// 归档压缩成 .gz 的分段可以直接传入
+#include "../logs_code/BinaryLog.hpp"
+#include "../logs_code/Formatter.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <zlib.h>
+
+namespace
+{
+    struct Site
+    {
+        mylog::LogLevel::value level;
+        uint32_t line;
+        std::string file;
+        std::string fmt;
+    };
+
+    class Decoder
+    {
+    public:
+        Decoder(const std::string& pattern, mylog::StructuredFormat structured) : formatter_(pattern, structured) {}
+
+        // 解码一个文件，结果写到标准输出，文件末尾不完整的帧(还在写入)忽略
+        bool DecodeFile(const std::string& path)
+        {
+            // gzread 对未压缩的文件原样读出，归档压缩过的 .gz 分段和正在写的分段都能直接解码
+            gzFile in = gzopen(path.c_str(), "rb");
+            if (in == NULL) {
+                std::cerr << "open " << path << " failed" << std::endl;
+                return false;
+            }
+            std::string data;
+            char buf[64 * 1024];
+            int n;
+            while ((n = gzread(in, buf, sizeof(buf))) > 0) data.append(buf, n);
+            if (n < 0) {
+                int err;
+                std::cerr << path << ": " << gzerror(in, &err) << std::endl;
+            }
+            gzclose(in);
+            size_t pos = 0;
+            while (data.size() - pos >= mylog::BinaryFrame::kFrameHeadSize) {
+                char type = data[pos];
+                uint32_t len;
+                memcpy(&len, data.data() + pos + 1, 4);
+                size_t body = pos + mylog::BinaryFrame::kFrameHeadSize;
+                if (data.size() - body < len) break;
+                if (!DecodeFrame(type, data.data() + body, len)) {
+                    std::cerr << path << ": bad frame at offset " << pos << std::endl;
+                    return false;
+                }
+                pos = body + len;
+            }
+            if (pos != data.size()) {
+                std::cerr << path << ": " << data.size() - pos << " trailing bytes ignored" << std::endl;
+            }
+            return true;
+        }
+
+    private:
+        struct Cursor
+        {
+            const char* cur;
+            const char* end;
+
+            template <typename T>
+            bool Get(T* v)
+            {
+                if (static_cast<size_t>(end - cur) < sizeof(T)) return false;
+                memcpy(v, cur, sizeof(T));
+                cur += sizeof(T);
+                return true;
+            }
+
+            bool GetString(size_t n, std::string* s)
+            {
+                if (static_cast<size_t>(end - cur) < n) return false;
+                s->assign(cur, n);
+                cur += n;
+                return true;
+            }
+        };
+
+        bool DecodeFrame(char type, const char* body, size_t len)
+        {
+            Cursor c{body, body + len};
+            switch (type) {
+                case 'H': {
+                    std::string magic;
+                    uint16_t version, name_len;
+                    if (!c.GetString(sizeof(mylog::BinaryFrame::kMagic), &magic) ||
+                        memcmp(magic.data(), mylog::BinaryFrame::kMagic, magic.size()) != 0)
+                        return false;
+                    if (!c.Get(&version)) {
+                        std::cerr << "truncated header" << std::endl;
+                        return false;
+                    }
+                    if (version != mylog::BinaryFrame::kVersion) {
+                        std::cerr << "unsupported version " << version << std::endl;
+                        return false;
+                    }
+                    return c.Get(&name_len) && c.GetString(name_len, &logger_name_);
+                }
+                case 'S': {
+                    uint32_t id, fmt_len;
+                    uint8_t level;
+                    uint16_t file_len;
+                    Site site;
+                    if (!c.Get(&id) || !c.Get(&level) || !c.Get(&site.line) || !c.Get(&file_len) ||
+                        !c.GetString(file_len, &site.file) || !c.Get(&fmt_len) || !c.GetString(fmt_len, &site.fmt))
+                        return false;
+                    site.level = static_cast<mylog::LogLevel::value>(level);
+                    sites_[id] = std::move(site);
+                    return true;
+                }
+                case 'R': {
+                    uint32_t id;
+                    int64_t ctime;
+                    uint64_t tid;
+                    if (!c.Get(&id) || !c.Get(&ctime) || !c.Get(&tid)) return false;
+                    auto it = sites_.find(id);
+                    if (it == sites_.end()) {
+                        std::cerr << "record refers to unknown site " << id << std::endl;
+                        return true;
+                    }
+                    const Site& site = it->second;
+                    std::string payload;
+                    mylog::BinaryArgs::Render(site.fmt.c_str(), c.cur, c.end - c.cur, &payload);
+                    Emit(site.level, site.file, site.line, ctime, tid, payload);
+                    return true;
+                }
+                case 'T':
+                case 'K': {
+                    uint8_t level;
+                    uint32_t line;
+                    int64_t ctime;
+                    uint64_t tid;
+                    uint16_t file_len;
+                    std::string file, payload;
+                    if (!c.Get(&level) || !c.Get(&line) || !c.Get(&ctime) || !c.Get(&tid) || !c.Get(&file_len) ||
+                        !c.GetString(file_len, &file) || !c.GetString(c.end - c.cur, &payload))
+                        return false;
+                    Emit(static_cast<mylog::LogLevel::value>(level), file, line, ctime, tid, payload, type == 'K');
+                    return true;
+                }
+                default:
+                    return true; // 新版本增加的帧类型，跳过
+            }
+        }
+
+        void Emit(mylog::LogLevel::value level, const std::string& file, size_t line,
+                  int64_t ctime, uint64_t tid, const std::string& payload, bool structured = false)
+        {
+            mylog::LogMessage msg(level, file.c_str(), line, logger_name_.c_str(), payload);
+            msg.structured_ = structured;
+            msg.ctime_ = static_cast<time_t>(ctime);
+            msg.tid_ = tid;
+            out_.clear();
+            formatter_.Format(msg, &out_);
+            fwrite(out_.data(), 1, out_.size(), stdout);
+        }
+
+    private:
+        mylog::Formatter formatter_;
+        std::string logger_name_;
+        std::unordered_map<uint32_t, Site> sites_;
+        std::string out_;
+    };
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string pattern = mylog::Formatter::kDefaultPattern;
+    mylog::StructuredFormat structured = mylog::StructuredFormat::LOGFMT;
+    int i = 1;
+    while (i < argc) {
+        if (i + 1 < argc && strcmp(argv[i], "-p") == 0) {
+            pattern = argv[i + 1];
+            i += 2;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            structured = mylog::StructuredFormat::JSON;
+            ++i;
+        } else {
+            break;
+        }
+    }
+    if (i >= argc) {
+        std::cerr << "Usage: " << argv[0] << " [-p pattern] [-j] file..." << std::endl;
+        return 1;
+    }
+    Decoder decoder(pattern, structured);
+    for (; i < argc; ++i) {
+        if (!decoder.DecodeFile(argv[i])) return 1;
+    }
+    return 0;
+}
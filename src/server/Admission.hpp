@@ -0,0 +1,341 @@
+#pragma once
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/http.h>
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 准入控制分两层：
+//   ConnectionBudget    接收阶段，evhttp 读完整个请求体才回调处理函数，每个连接最多缓冲 max_body_size，
+//                       所以在建立连接时就按 连接数 × max_body_size 不超过全局在途字节预算 限制连接数
+//   AdmissionController 处理阶段，限制同时进行的上传/下载数量以及正在处理的字节数(压缩、解压、读写文件)
+// 所有接口都只在 libevent 的事件线程中调用，不需要加锁
+// 请求被准入后，直到响应完全发出(on_complete)或连接断开(closecb)才归还配额
+// 配额不足时先排队，队列满或排队超时返回 503 + Retry-After
+namespace storage
+{
+    class ConnectionBudget
+    {
+    public:
+        // per_connection 为单个连接最多缓冲的字节数(max_body_size)，至少允许一个连接
+        ConnectionBudget(uint64_t max_bytes, uint64_t per_connection, int retry_after_sec)
+            : max_connections_(per_connection == 0 ? SIZE_MAX : std::max<uint64_t>(max_bytes / per_connection, 1)),
+              retry_after_sec_(retry_after_sec)
+        {
+        }
+
+        ~ConnectionBudget()
+        {
+            Detach();
+        }
+
+        // 由 evhttp 为每个新连接创建 bufferevent，从而在接收请求之前就能决定要不要这个连接
+        void Attach(struct evhttp *http)
+        {
+            evhttp_set_bevcb(http, OnNewConnection, this);
+        }
+
+        // evhttp_free 之后、event_base_free 之前调用，放掉对所有连接的引用
+        void Detach()
+        {
+            for (struct bufferevent *bev : live_)
+                bufferevent_decref(bev);
+            live_.clear();
+        }
+
+        size_t Live()
+        {
+            Sweep();
+            return live_.size();
+        }
+        size_t MaxConnections() const { return max_connections_; }
+        uint64_t Refused() const { return refused_; }
+
+    private:
+        // 给每个连接的 bufferevent 多持有一个引用，evhttp 释放连接时会清掉它的回调，据此判断连接已经关闭
+        void Sweep()
+        {
+            for (size_t i = 0; i < live_.size();)
+            {
+                void *arg = nullptr;
+                bufferevent_getcb(live_[i], nullptr, nullptr, nullptr, &arg);
+                if (arg != nullptr)
+                {
+                    ++i;
+                    continue;
+                }
+                bufferevent_decref(live_[i]);
+                live_[i] = live_.back();
+                live_.pop_back();
+            }
+        }
+
+        static struct bufferevent *OnNewConnection(struct event_base *base, void *arg)
+        {
+            ConnectionBudget *self = static_cast<ConnectionBudget *>(arg);
+            // 和 evhttp 默认创建的一样：不带 fd，也不在释放时关闭(evhttp 自己关)
+            struct bufferevent *bev = bufferevent_socket_new(base, -1, 0);
+            if (bev == NULL)
+                return NULL;
+            bufferevent_incref(bev);
+            self->Sweep();
+            if (self->live_.size() < self->max_connections_)
+            {
+                self->live_.push_back(bev);
+                return bev;
+            }
+            // evhttp 要等这个回调返回后才把 fd 交给 bufferevent，下一轮事件循环再回绝
+            self->refused_++;
+            struct timeval now = {0, 0};
+            if (event_base_once(base, -1, EV_TIMEOUT, Refuse, new Refusal{self, bev}, &now) != 0)
+                bufferevent_decref(bev);
+            return bev;
+        }
+
+        struct Refusal
+        {
+            ConnectionBudget *budget;
+            struct bufferevent *bev;
+        };
+
+        // 超出预算的连接：不读请求，直接回 503 后关闭读写，evhttp 读到 EOF 后释放连接
+        static void Refuse(evutil_socket_t, short, void *arg)
+        {
+            Refusal *r = static_cast<Refusal *>(arg);
+            evutil_socket_t fd = bufferevent_getfd(r->bev);
+            void *owner = nullptr;
+            bufferevent_getcb(r->bev, nullptr, nullptr, nullptr, &owner);
+            if (fd >= 0 && owner != nullptr)
+            {
+                std::string reply = "HTTP/1.1 503 Server Busy\r\nRetry-After: " + std::to_string(r->budget->retry_after_sec_) +
+                                    "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                send(fd, reply.data(), reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+                shutdown(fd, SHUT_RDWR);
+            }
+            bufferevent_decref(r->bev);
+            delete r;
+        }
+
+    private:
+        const size_t max_connections_;
+        const int retry_after_sec_;
+        std::vector<struct bufferevent *> live_; // 计入预算的连接
+        uint64_t refused_ = 0;
+    };
+
+    class AdmissionController
+    {
+    public:
+        enum class Kind
+        {
+            UPLOAD = 0,
+            DOWNLOAD = 1
+        };
+
+        struct Limits
+        {
+            size_t max_uploads = 16;
+            size_t max_downloads = 64;
+            uint64_t max_processing_bytes = 1ULL << 31;
+            size_t max_queue = 64;
+            int queue_timeout_ms = 3000;
+            int retry_after_sec = 1;
+        };
+
+        struct Stats
+        {
+            uint64_t admitted = 0;       // 准入总数(包括排队后准入的)
+            uint64_t queued = 0;         // 进入过排队队列的请求数
+            uint64_t rejected_full = 0;  // 队列已满被拒绝
+            uint64_t rejected_timeout = 0; // 排队超时被拒绝
+            size_t inflight_uploads = 0;
+            size_t inflight_downloads = 0;
+            uint64_t processing_bytes = 0;
+            size_t waiting = 0;          // 当前排队中的请求数
+        };
+
+        explicit AdmissionController(const Limits &limits) : limits_(limits) {}
+
+        ~AdmissionController()
+        {
+            if (timer_ != nullptr)
+                event_free(timer_);
+        }
+
+        // 启动排队超时检查的定时器
+        void Start(struct event_base *base)
+        {
+            timer_ = event_new(base, -1, EV_PERSIST, OnTimer, this);
+            struct timeval tv = {0, 200 * 1000};
+            event_add(timer_, &tv);
+        }
+
+        // 申请配额，成功则立即执行 run，否则排队或直接拒绝
+        void Admit(struct evhttp_request *req, Kind kind, uint64_t bytes, std::function<void()> run)
+        {
+            // 超过总预算的请求按总预算计，保证它在空闲时总能被准入
+            if (bytes > limits_.max_processing_bytes)
+                bytes = limits_.max_processing_bytes;
+
+            if (waiting_.empty() && TryAcquire(kind, bytes))
+            {
+                Track(req, kind, bytes);
+                run();
+                return;
+            }
+            if (waiting_.size() >= limits_.max_queue)
+            {
+                stats_.rejected_full++;
+                Reject(req);
+                return;
+            }
+            stats_.queued++;
+            Waiter w;
+            w.req = req;
+            w.kind = kind;
+            w.bytes = bytes;
+            w.run = std::move(run);
+            w.deadline = Clock::now() + std::chrono::milliseconds(limits_.queue_timeout_ms);
+            waiting_.push_back(std::move(w));
+        }
+
+        Stats GetStats() const
+        {
+            Stats s = stats_;
+            s.inflight_uploads = inflight_[static_cast<int>(Kind::UPLOAD)];
+            s.inflight_downloads = inflight_[static_cast<int>(Kind::DOWNLOAD)];
+            s.processing_bytes = processing_bytes_;
+            s.waiting = waiting_.size();
+            return s;
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Waiter
+        {
+            struct evhttp_request *req;
+            Kind kind;
+            uint64_t bytes;
+            std::function<void()> run;
+            Clock::time_point deadline;
+        };
+
+        struct Ticket
+        {
+            Kind kind;
+            uint64_t bytes;
+        };
+
+        bool TryAcquire(Kind kind, uint64_t bytes)
+        {
+            size_t limit = kind == Kind::UPLOAD ? limits_.max_uploads : limits_.max_downloads;
+            size_t &count = inflight_[static_cast<int>(kind)];
+            if (count >= limit || processing_bytes_ + bytes > limits_.max_processing_bytes)
+                return false;
+            count++;
+            processing_bytes_ += bytes;
+            stats_.admitted++;
+            return true;
+        }
+
+        void Release(const Ticket &ticket)
+        {
+            inflight_[static_cast<int>(ticket.kind)]--;
+            processing_bytes_ -= ticket.bytes;
+        }
+
+        // evhttp 的服务端连接同一时间只处理一个请求，所以按连接记录配额即可
+        void Track(struct evhttp_request *req, Kind kind, uint64_t bytes)
+        {
+            struct evhttp_connection *evcon = evhttp_request_get_connection(req);
+            tickets_[evcon] = Ticket{kind, bytes};
+            evhttp_request_set_on_complete_cb(req, OnComplete, this);
+            evhttp_connection_set_closecb(evcon, OnClose, this);
+        }
+
+        void Finish(struct evhttp_connection *evcon)
+        {
+            auto it = tickets_.find(evcon);
+            if (it == tickets_.end())
+                return;
+            Release(it->second);
+            tickets_.erase(it);
+            Drain();
+        }
+
+        // 按先来先服务的顺序放行排队的请求
+        void Drain()
+        {
+            while (!waiting_.empty())
+            {
+                Waiter &w = waiting_.front();
+                if (evhttp_request_get_connection(w.req) == NULL)
+                {
+                    // 客户端已经断开，回复即释放请求
+                    evhttp_send_reply(w.req, HTTP_SERVUNAVAIL, NULL, NULL);
+                    waiting_.pop_front();
+                    continue;
+                }
+                if (!TryAcquire(w.kind, w.bytes))
+                    return;
+                Waiter ready = std::move(w);
+                waiting_.pop_front();
+                Track(ready.req, ready.kind, ready.bytes);
+                ready.run();
+            }
+        }
+
+        void Reject(struct evhttp_request *req)
+        {
+            evhttp_add_header(evhttp_request_get_output_headers(req), "Retry-After",
+                              std::to_string(limits_.retry_after_sec).c_str());
+            evhttp_send_reply(req, HTTP_SERVUNAVAIL, "Server Busy", NULL);
+        }
+
+        void ExpireWaiters()
+        {
+            Clock::time_point now = Clock::now();
+            while (!waiting_.empty() && waiting_.front().deadline <= now)
+            {
+                struct evhttp_request *req = waiting_.front().req;
+                waiting_.pop_front();
+                stats_.rejected_timeout++;
+                Reject(req);
+            }
+        }
+
+        static void OnComplete(struct evhttp_request *req, void *arg)
+        {
+            static_cast<AdmissionController *>(arg)->Finish(evhttp_request_get_connection(req));
+        }
+
+        static void OnClose(struct evhttp_connection *evcon, void *arg)
+        {
+            static_cast<AdmissionController *>(arg)->Finish(evcon);
+        }
+
+        static void OnTimer(evutil_socket_t, short, void *arg)
+        {
+            static_cast<AdmissionController *>(arg)->ExpireWaiters();
+        }
+
+    private:
+        Limits limits_;
+        Stats stats_;
+        size_t inflight_[2] = {0, 0};
+        uint64_t processing_bytes_ = 0;
+        std::deque<Waiter> waiting_;
+        std::unordered_map<struct evhttp_connection *, Ticket> tickets_;
+        struct event *timer_ = nullptr;
+    };
+}
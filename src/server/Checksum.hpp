@@ -0,0 +1,159 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// CRC32C(Castagnoli) 校验
+// x86_64 上支持 SSE4.2 时使用 crc32 指令，否则走查表实现
+// 可以增量计算(Extend)，也可以把分别计算的两段合并(Combine)，分片上传时各分片独立计算再合并
+namespace storage
+{
+    class Crc32c
+    {
+    public:
+        // 在已有的 crc 后面追加 data，第一次调用传 0
+        static uint32_t Extend(uint32_t crc, const void *data, size_t len)
+        {
+            static const bool hw = HardwareSupported();
+#if defined(__x86_64__)
+            if (hw)
+                return ~ExtendHw(~crc, static_cast<const uint8_t *>(data), len);
+#endif
+            return ~ExtendSw(~crc, static_cast<const uint8_t *>(data), len);
+        }
+
+        // 已知 A 的 crc1 和 B 的 crc2(长度 len2)，求 A+B 的 crc，和 zlib 的 crc32_combine 同样的做法
+        static uint32_t Combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+        {
+            if (len2 == 0)
+                return crc1;
+            uint32_t even[32];
+            uint32_t odd[32];
+            odd[0] = kPoly; // 一个0比特对应的算子
+            uint32_t row = 1;
+            for (int n = 1; n < 32; n++)
+            {
+                odd[n] = row;
+                row <<= 1;
+            }
+            Gf2MatrixSquare(even, odd); // 2个0比特
+            Gf2MatrixSquare(odd, even); // 4个0比特
+            do
+            {
+                Gf2MatrixSquare(even, odd);
+                if (len2 & 1)
+                    crc1 = Gf2MatrixTimes(even, crc1);
+                len2 >>= 1;
+                if (len2 == 0)
+                    break;
+                Gf2MatrixSquare(odd, even);
+                if (len2 & 1)
+                    crc1 = Gf2MatrixTimes(odd, crc1);
+                len2 >>= 1;
+            } while (len2 != 0);
+            return crc1 ^ crc2;
+        }
+
+        static std::string ToHex(uint32_t crc)
+        {
+            char buf[9];
+            snprintf(buf, sizeof(buf), "%08x", crc);
+            return buf;
+        }
+
+        // 大端序的4个字节，用于 Digest 头
+        static std::string ToBytes(uint32_t crc)
+        {
+            std::string ret(4, '\0');
+            ret[0] = static_cast<char>(crc >> 24);
+            ret[1] = static_cast<char>(crc >> 16);
+            ret[2] = static_cast<char>(crc >> 8);
+            ret[3] = static_cast<char>(crc);
+            return ret;
+        }
+
+    private:
+        static constexpr uint32_t kPoly = 0x82f63b78; // 反射形式的多项式
+
+        static bool HardwareSupported()
+        {
+#if defined(__x86_64__)
+            return __builtin_cpu_supports("sse4.2");
+#else
+            return false;
+#endif
+        }
+
+#if defined(__x86_64__)
+        __attribute__((target("sse4.2"))) static uint32_t ExtendHw(uint32_t crc, const uint8_t *p, size_t len)
+        {
+            while (len > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0)
+            {
+                crc = _mm_crc32_u8(crc, *p++);
+                --len;
+            }
+            uint64_t crc64 = crc;
+            while (len >= 8)
+            {
+                crc64 = _mm_crc32_u64(crc64, *reinterpret_cast<const uint64_t *>(p));
+                p += 8;
+                len -= 8;
+            }
+            crc = static_cast<uint32_t>(crc64);
+            while (len > 0)
+            {
+                crc = _mm_crc32_u8(crc, *p++);
+                --len;
+            }
+            return crc;
+        }
+#endif
+
+        static uint32_t ExtendSw(uint32_t crc, const uint8_t *p, size_t len)
+        {
+            static const Table table;
+            while (len-- > 0)
+                crc = table.v[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+            return crc;
+        }
+
+        struct Table
+        {
+            uint32_t v[256];
+            Table()
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++)
+                        c = (c & 1) ? (c >> 1) ^ kPoly : c >> 1;
+                    v[i] = c;
+                }
+            }
+        };
+
+        static uint32_t Gf2MatrixTimes(const uint32_t *mat, uint32_t vec)
+        {
+            uint32_t sum = 0;
+            while (vec)
+            {
+                if (vec & 1)
+                    sum ^= *mat;
+                vec >>= 1;
+                mat++;
+            }
+            return sum;
+        }
+
+        static void Gf2MatrixSquare(uint32_t *square, const uint32_t *mat)
+        {
+            for (int n = 0; n < 32; n++)
+                square[n] = Gf2MatrixTimes(mat, mat[n]);
+        }
+    };
+}
@@ -17,6 +17,22 @@ namespace storage
         std::string low_storage_dir_;     // 浅度存储文件的存储路径
         std::string storage_info_;     // 已存储文件的信息
         int bundle_format_;//深度存储的文件后缀，由选择的压缩格式确定
+        // 准入控制
+        int64_t max_body_size_;           // 单个请求体的最大字节数，更大的文件走分片上传会话
+        int64_t max_inflight_bytes_;      // 全局在途字节预算，连接数 × max_body_size 不超过它
+        int max_concurrent_uploads_;      // 同时处理的上传数
+        int max_concurrent_downloads_;    // 同时处理的下载数
+        int64_t max_processing_bytes_;    // 同时处理的字节数上限，接收阶段由 max_inflight_bytes 限制
+        int admission_queue_size_;        // 配额不足时最多排队的请求数
+        int admission_queue_timeout_ms_;  // 排队超时时间
+        int retry_after_sec_;             // 503响应中的Retry-After
+        // 分片上传会话
+        std::string upload_session_dir_;  // 分片暂存目录
+        int upload_session_ttl_sec_;      // 会话无活动多久后回收
+        int upload_max_parts_;            // 单个会话最多分片数
+        int64_t upload_max_size_;         // 单个会话最大字节数，总大小未知时也按它限制分片的偏移
+        int64_t upload_max_deep_size_;    // 深度存储会话的最大字节数，完成时要整个读进内存压缩
+        bool verify_checksum_;            // 下载解压时校验CRC32C
     private:
         static std::mutex _mutex;
         static Config *_instance;
@@ -24,17 +40,17 @@ namespace storage
         {
             if (ReadConfig() == false)
             {
-                mylog::GetLogger("asynclogger")->Fatal("ReadConfig failed");
+                MYLOG_LOGGER("asynclogger")->Fatal("ReadConfig failed");
                 return;
             }
-            mylog::GetLogger("asynclogger")->Info("ReadConfig complicate");
+            MYLOG_LOGGER("asynclogger")->Info("ReadConfig complicate");
         }
 
     public:
         // 读取配置文件信息
         bool ReadConfig()
         {
-            mylog::GetLogger("asynclogger")->Info("ReadConfig start");
+            MYLOG_LOGGER("asynclogger")->Info("ReadConfig start");
 
             storage::FileUtil fu(Config_File);
             std::string content;
@@ -54,6 +70,21 @@ namespace storage
             deep_storage_dir_ = root["deep_storage_dir"].asString();
             low_storage_dir_ = root["low_storage_dir"].asString();
             bundle_format_ = root["bundle_format"].asInt();
+            // 以下配置项缺省时使用默认值
+            max_body_size_ = root.get("max_body_size", (Json::Int64)16 << 20).asInt64();
+            max_inflight_bytes_ = root.get("max_inflight_bytes", (Json::Int64)1 << 31).asInt64();
+            max_concurrent_uploads_ = root.get("max_concurrent_uploads", 16).asInt();
+            max_concurrent_downloads_ = root.get("max_concurrent_downloads", 64).asInt();
+            max_processing_bytes_ = root.get("max_processing_bytes", (Json::Int64)1 << 31).asInt64();
+            admission_queue_size_ = root.get("admission_queue_size", 64).asInt();
+            admission_queue_timeout_ms_ = root.get("admission_queue_timeout_ms", 3000).asInt();
+            retry_after_sec_ = root.get("retry_after_sec", 1).asInt();
+            upload_session_dir_ = root.get("upload_session_dir", "./upload_sessions/").asString();
+            upload_session_ttl_sec_ = root.get("upload_session_ttl_sec", 3600).asInt();
+            upload_max_parts_ = root.get("upload_max_parts", 10000).asInt();
+            upload_max_size_ = root.get("upload_max_size", (Json::Int64)1 << 34).asInt64();
+            upload_max_deep_size_ = root.get("upload_max_deep_size", (Json::Int64)64 << 20).asInt64();
+            verify_checksum_ = root.get("verify_checksum", true).asBool();
             
             return true;
         }
@@ -85,6 +116,62 @@ namespace storage
         {
             return storage_info_;
         }
+        int64_t GetMaxBodySize()
+        {
+            return max_body_size_;
+        }
+        int GetMaxConcurrentUploads()
+        {
+            return max_concurrent_uploads_;
+        }
+        int GetMaxConcurrentDownloads()
+        {
+            return max_concurrent_downloads_;
+        }
+        int64_t GetMaxInflightBytes()
+        {
+            return max_inflight_bytes_;
+        }
+        int64_t GetMaxProcessingBytes()
+        {
+            return max_processing_bytes_;
+        }
+        int GetAdmissionQueueSize()
+        {
+            return admission_queue_size_;
+        }
+        int GetAdmissionQueueTimeoutMs()
+        {
+            return admission_queue_timeout_ms_;
+        }
+        int GetRetryAfterSec()
+        {
+            return retry_after_sec_;
+        }
+        std::string GetUploadSessionDir()
+        {
+            return upload_session_dir_;
+        }
+        int GetUploadSessionTtlSec()
+        {
+            return upload_session_ttl_sec_;
+        }
+        int GetUploadMaxParts()
+        {
+            return upload_max_parts_;
+        }
+        int64_t GetUploadMaxSize()
+        {
+            return upload_max_size_;
+        }
+        int64_t GetUploadMaxDeepSize()
+        {
+            return upload_max_deep_size_;
+        }
+        bool GetVerifyChecksum()
+        {
+            return verify_checksum_;
+        }
 
     public:
         // 获取单例类对象
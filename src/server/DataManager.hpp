@@ -11,15 +11,17 @@ namespace storage
         size_t fsize_;
         std::string storage_path_; // 文件存储路径
         std::string url_;          // 请求URL中的资源路径
+        uint32_t crc32c_ = 0;      // 原始文件内容的CRC32C，上传时顺带计算
+        bool has_crc32c_ = false;  // 旧数据没有校验值
 
         bool NewStorageInfo(const std::string &storage_path)
         {
             // 初始化备份文件的信息
-            mylog::GetLogger("asynclogger")->Info("NewStorageInfo start");
+            MYLOG_LOGGER("asynclogger")->Info("NewStorageInfo start");
             FileUtil f(storage_path);
             if (!f.Exists())
             {
-                mylog::GetLogger("asynclogger")->Info("file not exists");
+                MYLOG_LOGGER("asynclogger")->Info("file not exists");
                 return false;
             }
             mtime_ = f.LastAccessTime();
@@ -30,8 +32,9 @@ namespace storage
             // 下载路径前缀+文件名
             storage::Config *config = storage::Config::GetInstance();
             url_ = config->GetDownloadPrefix() + f.FileName();
-            mylog::GetLogger("asynclogger")->Info("download_url:%s,mtime_:%s,atime_:%s,fsize_:%d", url_.c_str(),ctime(&mtime_),ctime(&atime_),fsize_);
-            mylog::GetLogger("asynclogger")->Info("NewStorageInfo end");
+            MYLOG_LOGGER("asynclogger")->Info("storage_info", mylog::kv("download_url", url_), mylog::kv("mtime", mtime_),
+                                              mylog::kv("atime", atime_), mylog::kv("fsize", fsize_));
+            MYLOG_LOGGER("asynclogger")->Info("NewStorageInfo end");
             return true;
         }
     } StorageInfo; // namespace StorageInfo
@@ -47,13 +50,13 @@ namespace storage
     public:
         DataManager()
         {
-            mylog::GetLogger("asynclogger")->Info("DataManager construct start");
+            MYLOG_LOGGER("asynclogger")->Info("DataManager construct start");
             storage_file_ = storage::Config::GetInstance()->GetStorageInfoFile();
             pthread_rwlock_init(&rwlock_, NULL);
             need_persist_ = false;
             InitLoad();
             need_persist_ = true;
-            mylog::GetLogger("asynclogger")->Info("DataManager construct end");
+            MYLOG_LOGGER("asynclogger")->Info("DataManager construct end");
         }
         ~DataManager()
         {
@@ -62,10 +65,10 @@ namespace storage
 
         bool InitLoad() // 初始化程序运行时从文件读取数据
         {
-            mylog::GetLogger("asynclogger")->Info("init datamanager");
+            MYLOG_LOGGER("asynclogger")->Info("init datamanager");
             storage::FileUtil f(storage_file_);
             if (!f.Exists()){
-                mylog::GetLogger("asynclogger")->Info("there is no storage file info need to load");
+                MYLOG_LOGGER("asynclogger")->Info("there is no storage file info need to load");
                 return true;
             }
 
@@ -85,6 +88,11 @@ namespace storage
                 info.mtime_ = root[i]["mtime_"].asInt();
                 info.storage_path_ = root[i]["storage_path_"].asString();
                 info.url_ = root[i]["url_"].asString();
+                if (root[i].isMember("crc32c_"))
+                {
+                    info.crc32c_ = root[i]["crc32c_"].asUInt();
+                    info.has_crc32c_ = true;
+                }
                 Insert(info);
             }
             return true;
@@ -93,11 +101,11 @@ namespace storage
         bool Storage()
         { // 每次有信息改变则需要持久化存储一次
 // 把table_中的数据转成json格式存入文件
-            mylog::GetLogger("asynclogger")->Info("message storage start");
+            MYLOG_LOGGER("asynclogger")->Info("message storage start");
             std::vector<StorageInfo> arr;
             if (!GetAll(&arr))
             {
-                mylog::GetLogger("asynclogger")->Warn("GetAll fail,can't get StorageInfo");
+                MYLOG_LOGGER("asynclogger")->Warn("GetAll fail,can't get StorageInfo");
                 return false;
             }
 
@@ -110,51 +118,53 @@ namespace storage
                 item["fsize_"] = (Json::Int64)e.fsize_;
                 item["url_"] = e.url_.c_str();
                 item["storage_path_"] = e.storage_path_.c_str();
+                if (e.has_crc32c_)
+                    item["crc32c_"] = (Json::UInt)e.crc32c_;
                 root.append(item); // 作为数组
             }
 
             // 序列化
             std::string body;
             JsonUtil::Serialize(root, &body);
-            mylog::GetLogger("asynclogger")->Info("new message for StorageInfo:%s", body.c_str());    //打印序列化后的文件信息
+            MYLOG_LOGGER("asynclogger")->Info("new message for StorageInfo:%s", body.c_str());    //打印序列化后的文件信息
 
             // 写入文件
             FileUtil f(storage_file_);
             
             if (f.SetContent(body.c_str(),body.size()) == false)
-                mylog::GetLogger("asynclogger")->Error("SetContent for StorageInfo Error");
+                MYLOG_LOGGER("asynclogger")->Error("SetContent for StorageInfo Error");
 
-            mylog::GetLogger("asynclogger")->Info("message storage end");
+            MYLOG_LOGGER("asynclogger")->Info("message storage end");
             return true;
         }
 
         bool Insert(const StorageInfo &info)
         {
-            mylog::GetLogger("asynclogger")->Info("data_message Insert start");
+            MYLOG_LOGGER("asynclogger")->Info("data_message Insert start");
             pthread_rwlock_wrlock(&rwlock_); // 加写锁
             table_[info.url_] = info;
             pthread_rwlock_unlock(&rwlock_);
             if (need_persist_ == true && Storage() == false)
             {
-                mylog::GetLogger("asynclogger")->Error("data_message Insert:Storage Error");
+                MYLOG_LOGGER("asynclogger")->Error("data_message Insert:Storage Error");
                 return false;
             }
-            mylog::GetLogger("asynclogger")->Info("data_message Insert end");
+            MYLOG_LOGGER("asynclogger")->Info("data_message Insert end");
             return true;
         }
 
         bool Update(const StorageInfo &info)
         {
-            mylog::GetLogger("asynclogger")->Info("data_message Update start");
+            MYLOG_LOGGER("asynclogger")->Info("data_message Update start");
             pthread_rwlock_wrlock(&rwlock_);
             table_[info.url_] = info;
             pthread_rwlock_unlock(&rwlock_);
             if (Storage() == false)
             {
-                mylog::GetLogger("asynclogger")->Error("data_message Update:Storage Error");
+                MYLOG_LOGGER("asynclogger")->Error("data_message Update:Storage Error");
                 return false;
             }
-            mylog::GetLogger("asynclogger")->Info("data_message Update end");
+            MYLOG_LOGGER("asynclogger")->Info("data_message Update end");
             return true;
         }
         bool GetOneByURL(const std::string &key, StorageInfo *info)
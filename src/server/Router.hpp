@@ -0,0 +1,276 @@
+#pragma once
+#include <event2/http.h>
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 基于基数树(radix trie)的请求路由
+// 路由模式支持三种片段：
+//   静态文本       "/upload"
+//   命名参数       "/session/:id"     匹配到下一个'/'为止，不能为空
+//   通配剩余路径   "/download/*name"  匹配剩余的全部路径，只能出现在末尾，不能为空
+// 匹配优先级：静态 > 命名参数 > 通配，匹配代价只和路径长度有关，和路由数量无关
+namespace storage
+{
+    class RouteParams
+    {
+    public:
+        void Add(const std::string &name, std::string value)
+        {
+            params_.emplace_back(name, std::move(value));
+        }
+        void Pop()
+        {
+            params_.pop_back();
+        }
+        void Clear()
+        {
+            params_.clear();
+        }
+        // 参数不存在时返回空串
+        const std::string &Get(const std::string &name) const
+        {
+            static const std::string empty;
+            for (const auto &p : params_)
+            {
+                if (p.first == name)
+                    return p.second;
+            }
+            return empty;
+        }
+
+    private:
+        std::vector<std::pair<std::string, std::string>> params_;
+    };
+
+    // 一次请求在路由阶段得到的信息，交给具体的处理函数
+    struct RouteContext
+    {
+        std::string path; // 解码后的请求路径
+        RouteParams params;
+    };
+
+    using RouteHandler = std::function<void(struct evhttp_request *, RouteContext &)>;
+
+    class Router
+    {
+    public:
+        enum class MatchResult
+        {
+            FOUND,
+            METHOD_NOT_ALLOWED,
+            NOT_FOUND
+        };
+
+        Router() : root_(new Node) {}
+
+        // methods 是 evhttp_cmd_type 的按位或，例如 EVHTTP_REQ_GET | EVHTTP_REQ_HEAD
+        // 模式非法或与已有路由冲突时返回false
+        bool Add(int methods, const std::string &pattern, RouteHandler handler)
+        {
+            if (pattern.empty() || pattern[0] != '/' || methods == 0 || !handler)
+                return false;
+            Node *node = Insert(root_.get(), pattern, 0);
+            if (node == nullptr)
+                return false;
+            for (size_t i = 0; i < kMethodSlots; ++i)
+            {
+                if ((methods & (1 << i)) == 0)
+                    continue;
+                if (node->handlers[i])
+                    return false; // 同一方法重复注册
+                node->handlers[i] = handler;
+            }
+            node->methods |= methods;
+            return true;
+        }
+
+        // 路径匹配但方法不对时返回 METHOD_NOT_ALLOWED，并通过 allowed 带回可用的方法
+        MatchResult Match(evhttp_cmd_type method, const std::string &path,
+                          RouteHandler *handler, RouteParams *params, int *allowed) const
+        {
+            params->Clear();
+            const Node *node = Find(root_.get(), path, 0, params);
+            if (node == nullptr)
+                return MatchResult::NOT_FOUND;
+            int slot = SlotOf(method);
+            if (slot < 0 || !node->handlers[slot])
+            {
+                if (allowed != nullptr)
+                    *allowed = node->methods;
+                return MatchResult::METHOD_NOT_ALLOWED;
+            }
+            *handler = node->handlers[slot];
+            return MatchResult::FOUND;
+        }
+
+        // 生成 Allow 响应头的值
+        static std::string MethodNames(int methods)
+        {
+            static const char *names[kMethodSlots] = {"GET", "POST", "HEAD", "PUT", "DELETE",
+                                                      "OPTIONS", "TRACE", "CONNECT", "PATCH"};
+            std::string ret;
+            for (size_t i = 0; i < kMethodSlots; ++i)
+            {
+                if ((methods & (1 << i)) == 0)
+                    continue;
+                if (!ret.empty())
+                    ret += ", ";
+                ret += names[i];
+            }
+            return ret;
+        }
+
+    private:
+        // EVHTTP_REQ_GET ... EVHTTP_REQ_PATCH 依次占用 bit0 ~ bit8
+        static constexpr size_t kMethodSlots = 9;
+
+        struct Node
+        {
+            std::string prefix;                          // 静态边上的文本
+            std::vector<std::unique_ptr<Node>> children; // 静态子节点，首字符互不相同
+            std::unique_ptr<Node> param;                 // ":name" 子节点
+            std::unique_ptr<Node> wildcard;              // "*name" 子节点
+            std::string name;                            // 参数名，仅参数/通配节点使用
+            std::array<RouteHandler, kMethodSlots> handlers;
+            int methods = 0;
+        };
+
+        static int SlotOf(evhttp_cmd_type method)
+        {
+            unsigned int bits = static_cast<unsigned int>(method);
+            if (bits == 0 || (bits & (bits - 1)) != 0)
+                return -1;
+            int slot = __builtin_ctz(bits);
+            return slot < static_cast<int>(kMethodSlots) ? slot : -1;
+        }
+
+        static Node *Insert(Node *node, const std::string &pattern, size_t pos)
+        {
+            if (pos == pattern.size())
+                return node;
+
+            if (pattern[pos] == ':')
+            {
+                size_t end = pattern.find('/', pos);
+                if (end == std::string::npos)
+                    end = pattern.size();
+                std::string name = pattern.substr(pos + 1, end - pos - 1);
+                if (name.empty())
+                    return nullptr;
+                if (!node->param)
+                {
+                    node->param.reset(new Node);
+                    node->param->name = name;
+                }
+                else if (node->param->name != name)
+                {
+                    return nullptr; // 同一位置的参数名必须一致
+                }
+                return Insert(node->param.get(), pattern, end);
+            }
+
+            if (pattern[pos] == '*')
+            {
+                std::string name = pattern.substr(pos + 1);
+                if (name.empty() || name.find_first_of("/:*") != std::string::npos)
+                    return nullptr;
+                if (!node->wildcard)
+                {
+                    node->wildcard.reset(new Node);
+                    node->wildcard->name = name;
+                }
+                else if (node->wildcard->name != name)
+                {
+                    return nullptr;
+                }
+                return node->wildcard.get();
+            }
+
+            size_t end = pattern.find_first_of(":*", pos);
+            if (end == std::string::npos)
+                end = pattern.size();
+            Node *child = InsertStatic(node, pattern.substr(pos, end - pos));
+            return Insert(child, pattern, end);
+        }
+
+        // 在node下插入一段静态文本，必要时拆分已有的边，返回文本末尾所在的节点
+        static Node *InsertStatic(Node *node, const std::string &text)
+        {
+            for (auto &child : node->children)
+            {
+                if (child->prefix[0] != text[0])
+                    continue;
+                size_t common = 0;
+                size_t limit = std::min(child->prefix.size(), text.size());
+                while (common < limit && child->prefix[common] == text[common])
+                    ++common;
+
+                if (common < child->prefix.size())
+                {
+                    // 拆分: child 变成 mid 的子节点
+                    std::unique_ptr<Node> mid(new Node);
+                    mid->prefix = child->prefix.substr(0, common);
+                    child->prefix.erase(0, common);
+                    mid->children.emplace_back(std::move(child));
+                    child = std::move(mid);
+                }
+                if (common == text.size())
+                    return child.get();
+                return InsertStatic(child.get(), text.substr(common));
+            }
+            node->children.emplace_back(new Node);
+            node->children.back()->prefix = text;
+            return node->children.back().get();
+        }
+
+        static const Node *Find(const Node *node, const std::string &path, size_t pos, RouteParams *params)
+        {
+            if (pos == path.size())
+                return node->methods != 0 ? node : nullptr;
+
+            for (const auto &child : node->children)
+            {
+                if (child->prefix[0] != path[pos])
+                    continue;
+                if (path.compare(pos, child->prefix.size(), child->prefix) == 0)
+                {
+                    const Node *found = Find(child.get(), path, pos + child->prefix.size(), params);
+                    if (found != nullptr)
+                        return found;
+                }
+                break; // 首字符互不相同，最多只有一个候选
+            }
+
+            if (node->param)
+            {
+                size_t end = path.find('/', pos);
+                if (end == std::string::npos)
+                    end = path.size();
+                if (end > pos)
+                {
+                    params->Add(node->param->name, path.substr(pos, end - pos));
+                    const Node *found = Find(node->param.get(), path, end, params);
+                    if (found != nullptr)
+                        return found;
+                    params->Pop();
+                }
+            }
+
+            if (node->wildcard && node->wildcard->methods != 0)
+            {
+                params->Add(node->wildcard->name, path.substr(pos));
+                return node->wildcard.get();
+            }
+            return nullptr;
+        }
+
+    private:
+        std::unique_ptr<Node> root_;
+    };
+}
@@ -13,6 +13,9 @@
 #include <regex>
 
 #include "base64.h" 
+#include "Router.hpp"
+#include "Admission.hpp"
+#include "UploadSession.hpp"
 
 extern storage::DataManager *data_;
 namespace storage
@@ -20,16 +23,19 @@ namespace storage
     class Service
     {
     public:
-        Service()
+        Service() : connections_(Config::GetInstance()->GetMaxInflightBytes(), Config::GetInstance()->GetMaxBodySize(),
+                                 Config::GetInstance()->GetRetryAfterSec()),
+                    admission_(LoadAdmissionLimits())
         {
 #ifdef DEBUG_LOG
-            mylog::GetLogger("asynclogger")->Debug("Service start(Construct)");
+            MYLOG_LOGGER("asynclogger")->Debug("Service start(Construct)");
 #endif
             server_port_ = Config::GetInstance()->GetServerPort();
             server_ip_ = Config::GetInstance()->GetServerIp();
             download_prefix_ = Config::GetInstance()->GetDownloadPrefix();
+            RegisterRoutes();
 #ifdef DEBUG_LOG
-            mylog::GetLogger("asynclogger")->Debug("Service end(Construct)");
+            MYLOG_LOGGER("asynclogger")->Debug("Service end(Construct)");
 #endif
         }
         bool RunModule()
@@ -38,7 +44,7 @@ namespace storage
             event_base *base = event_base_new();
             if (base == NULL)
             {
-                mylog::GetLogger("asynclogger")->Fatal("event_base_new err!");
+                MYLOG_LOGGER("asynclogger")->Fatal("event_base_new err!");
                 return false;
             }
             // 设置监听的端口和地址
@@ -48,30 +54,42 @@ namespace storage
             sin.sin_port = htons(server_port_);
             // http 服务器,创建evhttp上下文
             evhttp *httpd = evhttp_new(base);
+            // 超过该大小的请求体由libevent直接拒绝，避免整个读入内存
+            evhttp_set_max_body_size(httpd, Config::GetInstance()->GetMaxBodySize());
+            // 每个连接最多缓冲一个请求体，连接数超出在途字节预算时新连接直接回 503
+            connections_.Attach(httpd);
+            admission_.Start(base);
+            // 定期回收过期的分片上传会话
+            struct event *session_gc = event_new(base, -1, EV_PERSIST, SessionGC, this);
+            struct timeval gc_interval = {60, 0};
+            event_add(session_gc, &gc_interval);
             // 绑定端口和ip
             if (evhttp_bind_socket(httpd, "0.0.0.0", server_port_) != 0)
             {
-                mylog::GetLogger("asynclogger")->Fatal("evhttp_bind_socket failed!");
+                MYLOG_LOGGER("asynclogger")->Fatal("evhttp_bind_socket failed!");
                 return false;
             }
             // 设定回调函数
             // 指定generic callback，也可以为特定的URI指定callback，
-            evhttp_set_gencb(httpd, GenHandler, NULL);
+            evhttp_set_gencb(httpd, GenHandler, this);
 
             if (base)
             {
 #ifdef DEBUG_LOG
-                mylog::GetLogger("asynclogger")->Debug("event_base_dispatch");
+                MYLOG_LOGGER("asynclogger")->Debug("event_base_dispatch");
 #endif
                 if (-1 == event_base_dispatch(base))
                 {
-                    mylog::GetLogger("asynclogger")->Debug("event_base_dispatch err");
+                    MYLOG_LOGGER("asynclogger")->Debug("event_base_dispatch err");
                 }
             }
-            if (base)
-                event_base_free(base);
+            event_free(session_gc);
+            // 连接的 bufferevent 还挂在 base 上，先释放 evhttp 再释放 base
             if (httpd)
                 evhttp_free(httpd);
+            connections_.Detach();
+            if (base)
+                event_base_free(base);
             return true;
         }
 
@@ -79,63 +97,303 @@ namespace storage
         uint16_t server_port_;
         std::string server_ip_;
         std::string download_prefix_;
+        Router router_;
+        ConnectionBudget connections_;
+        AdmissionController admission_;
+        UploadSessionManager sessions_;
 
     private:
+        static AdmissionController::Limits LoadAdmissionLimits()
+        {
+            Config *config = Config::GetInstance();
+            AdmissionController::Limits limits;
+            limits.max_uploads = config->GetMaxConcurrentUploads();
+            limits.max_downloads = config->GetMaxConcurrentDownloads();
+            limits.max_processing_bytes = config->GetMaxProcessingBytes();
+            limits.max_queue = config->GetAdmissionQueueSize();
+            limits.queue_timeout_ms = config->GetAdmissionQueueTimeoutMs();
+            limits.retry_after_sec = config->GetRetryAfterSec();
+            return limits;
+        }
+
+        // 给处理函数套上准入控制，bytes_of 估算该请求要处理的字节数
+        RouteHandler Admitted(AdmissionController::Kind kind,
+                              std::function<uint64_t(struct evhttp_request *, RouteContext &)> bytes_of,
+                              RouteHandler handler)
+        {
+            return [this, kind, bytes_of, handler](struct evhttp_request *req, RouteContext &ctx)
+            {
+                uint64_t bytes = bytes_of(req, ctx);
+                admission_.Admit(req, kind, bytes, [handler, req, ctx]() mutable
+                                 { handler(req, ctx); });
+            };
+        }
+        static uint64_t BodyBytes(struct evhttp_request *req, RouteContext &ctx)
+        {
+            return evbuffer_get_length(evhttp_request_get_input_buffer(req));
+        }
+        static uint64_t StoredFileBytes(struct evhttp_request *req, RouteContext &ctx)
+        {
+            StorageInfo info;
+            if (data_->GetOneByURL(ctx.path, &info) == false)
+                return 0;
+            return info.fsize_;
+        }
+
+        // 注册所有接口，新增接口只需要在这里加一行，不会增加每个请求的匹配开销
+        void RegisterRoutes()
+        {
+            bool ok = true;
+            // 下载请求，前缀来自配置文件，剩余部分就是文件名
+            ok &= router_.Add(EVHTTP_REQ_GET | EVHTTP_REQ_HEAD, download_prefix_ + "*filename",
+                              Admitted(AdmissionController::Kind::DOWNLOAD, StoredFileBytes, Download));
+            // 上传
+            ok &= router_.Add(EVHTTP_REQ_POST, "/upload",
+                              Admitted(AdmissionController::Kind::UPLOAD, BodyBytes, Upload));
+            // 显示已存储文件列表，返回一个html页面给浏览器
+            ok &= router_.Add(EVHTTP_REQ_GET | EVHTTP_REQ_HEAD, "/", ListShow);
+            // 分片上传会话：创建、上传分片、查询、完成、放弃
+            ok &= router_.Add(EVHTTP_REQ_POST, "/upload/session", [this](struct evhttp_request *req, RouteContext &ctx)
+                              { SessionCreate(req, ctx); });
+            ok &= router_.Add(EVHTTP_REQ_PUT, "/upload/session/:id/part/:part",
+                              Admitted(AdmissionController::Kind::UPLOAD, BodyBytes, [this](struct evhttp_request *req, RouteContext &ctx)
+                                       { SessionPutPart(req, ctx); }));
+            ok &= router_.Add(EVHTTP_REQ_GET, "/upload/session/:id", [this](struct evhttp_request *req, RouteContext &ctx)
+                              { SessionList(req, ctx); });
+            ok &= router_.Add(EVHTTP_REQ_DELETE, "/upload/session/:id", [this](struct evhttp_request *req, RouteContext &ctx)
+                              { SessionAbort(req, ctx); });
+            ok &= router_.Add(EVHTTP_REQ_POST, "/upload/session/:id/complete",
+                              Admitted(AdmissionController::Kind::UPLOAD, [this](struct evhttp_request *req, RouteContext &ctx)
+                                       { return sessions_.ReceivedBytes(ctx.params.Get("id")); },
+                                       [this](struct evhttp_request *req, RouteContext &ctx)
+                                       { SessionComplete(req, ctx); }));
+            // 服务端运行指标
+            ok &= router_.Add(EVHTTP_REQ_GET, "/metrics", [this](struct evhttp_request *req, RouteContext &ctx)
+                              { Metrics(req, ctx); });
+            if (!ok)
+            {
+                MYLOG_LOGGER("asynclogger")->Fatal("RegisterRoutes failed, download_prefix:%s", download_prefix_.c_str());
+            }
+        }
+
         static void GenHandler(struct evhttp_request *req, void *arg)
         {
-            std::string path = evhttp_uri_get_path(evhttp_request_get_evhttp_uri(req));
-            path = UrlDecode(path);
-            mylog::GetLogger("asynclogger")->Info("get req, uri: %s", path.c_str());
+            Service *service = static_cast<Service *>(arg);
+            RouteContext ctx;
+            const char *raw_path = evhttp_uri_get_path(evhttp_request_get_evhttp_uri(req));
+            if (raw_path == NULL || UrlDecode(raw_path, &ctx.path) == false)
+            {
+                INFO_LIMITED(MYLOG_LOGGER("asynclogger"), "get req, bad uri");
+                evhttp_send_reply(req, HTTP_BADREQUEST, "Bad Request", NULL);
+                return;
+            }
+            INFO_LIMITED(MYLOG_LOGGER("asynclogger"), "get req, uri: %s", ctx.path.c_str());
 
-            // 根据请求中的内容判断是什么请求
-            // 这里是下载请求
-            if (path.find("/download/") != std::string::npos)
+            // 根据方法和路径在路由表中查找处理函数
+            RouteHandler handler;
+            int allowed = 0;
+            switch (service->router_.Match(evhttp_request_get_command(req), ctx.path, &handler, &ctx.params, &allowed))
             {
-                Download(req, arg);
+            case Router::MatchResult::FOUND:
+                handler(req, ctx);
+                break;
+            case Router::MatchResult::METHOD_NOT_ALLOWED:
+                evhttp_add_header(evhttp_request_get_output_headers(req), "Allow", Router::MethodNames(allowed).c_str());
+                evhttp_send_reply(req, 405, "Method Not Allowed", NULL);
+                break;
+            default:
+                evhttp_send_reply(req, HTTP_NOTFOUND, "Not Found", NULL);
+                break;
             }
-            // 这里是上传
-            else if (path == "/upload")
+        }
+
+        void Metrics(struct evhttp_request *req, RouteContext &ctx)
+        {
+            AdmissionController::Stats stats = admission_.GetStats();
+            Json::Value root;
+            Json::Value &admission = root["admission"];
+            admission["admitted"] = (Json::UInt64)stats.admitted;
+            admission["queued"] = (Json::UInt64)stats.queued;
+            admission["rejected_queue_full"] = (Json::UInt64)stats.rejected_full;
+            admission["rejected_timeout"] = (Json::UInt64)stats.rejected_timeout;
+            admission["inflight_uploads"] = (Json::UInt64)stats.inflight_uploads;
+            admission["inflight_downloads"] = (Json::UInt64)stats.inflight_downloads;
+            admission["processing_bytes"] = (Json::UInt64)stats.processing_bytes;
+            admission["waiting"] = (Json::UInt64)stats.waiting;
+            Json::Value &connections = root["connections"];
+            connections["live"] = (Json::UInt64)connections_.Live();
+            connections["max"] = (Json::UInt64)connections_.MaxConnections();
+            connections["refused"] = (Json::UInt64)connections_.Refused();
+
+            SendJson(req, HTTP_OK, root);
+        }
+
+        static void SendJson(struct evhttp_request *req, int code, const Json::Value &root)
+        {
+            std::string body;
+            JsonUtil::Serialize(root, &body);
+            evbuffer_add(evhttp_request_get_output_buffer(req), body.c_str(), body.size());
+            evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "application/json");
+            evhttp_send_reply(req, code, NULL, NULL);
+        }
+
+        // 只接受纯数字，避免 strtoull 把 "12abc" 或 "-1" 当成合法值
+        static bool ParseUint(const char *str, uint64_t *out)
+        {
+            if (str == NULL || *str == '\0')
+                return false;
+            uint64_t val = 0;
+            for (const char *p = str; *p; ++p)
             {
-                Upload(req, arg);
+                if (*p < '0' || *p > '9' || val > (UINT64_MAX - 9) / 10)
+                    return false;
+                val = val * 10 + (*p - '0');
             }
-            // 这里就是显示已存储文件列表，返回一个html页面给浏览器
-            else if (path == "/")
+            *out = val;
+            return true;
+        }
+
+        static void SendSessionStatus(struct evhttp_request *req, SessionStatus status)
+        {
+            switch (status)
             {
-                ListShow(req, arg);
+            case SessionStatus::OK:
+                evhttp_send_reply(req, HTTP_OK, "Success", NULL);
+                break;
+            case SessionStatus::NOT_FOUND:
+                evhttp_send_reply(req, HTTP_NOTFOUND, "upload session not exists", NULL);
+                break;
+            case SessionStatus::BAD_REQUEST:
+                evhttp_send_reply(req, HTTP_BADREQUEST, "bad upload session request", NULL);
+                break;
+            case SessionStatus::CONFLICT:
+                evhttp_send_reply(req, 409, "parts overlap or incomplete", NULL);
+                break;
+            default:
+                evhttp_send_reply(req, HTTP_INTERNAL, "server error", NULL);
+                break;
             }
-            else
+        }
+
+        static void SessionGC(evutil_socket_t, short, void *arg)
+        {
+            static_cast<Service *>(arg)->sessions_.CollectGarbage();
+        }
+
+        // 创建会话，请求头 FileName(base64)、StorageType 同普通上传，可选 FileSize 用于预分配
+        void SessionCreate(struct evhttp_request *req, RouteContext &ctx)
+        {
+            const char *filename = evhttp_find_header(req->input_headers, "FileName");
+            const char *storage_type = evhttp_find_header(req->input_headers, "StorageType");
+            const char *file_size = evhttp_find_header(req->input_headers, "FileSize");
+            uint64_t total_size = 0;
+            if (filename == NULL || storage_type == NULL || (file_size != NULL && !ParseUint(file_size, &total_size)))
             {
-                evhttp_send_reply(req, HTTP_NOTFOUND, "Not Found", NULL);
+                evhttp_send_reply(req, HTTP_BADREQUEST, "missing FileName or StorageType", NULL);
+                return;
+            }
+            std::string id;
+            SessionStatus status = sessions_.Create(base64_decode(std::string(filename)), storage_type, total_size, &id);
+            if (status != SessionStatus::OK)
+            {
+                SendSessionStatus(req, status);
+                return;
+            }
+            MYLOG_LOGGER("asynclogger")->Info("upload session %s created, size:%llu", id.c_str(), (unsigned long long)total_size);
+            Json::Value root;
+            root["upload_id"] = id;
+            SendJson(req, HTTP_OK, root);
+        }
+
+        // 上传第 part 个分片，请求头 Part-Offset 指明该分片在文件中的偏移
+        void SessionPutPart(struct evhttp_request *req, RouteContext &ctx)
+        {
+            uint64_t part_no = 0;
+            uint64_t offset = 0;
+            if (!ParseUint(ctx.params.Get("part").c_str(), &part_no) || part_no > UINT32_MAX ||
+                !ParseUint(evhttp_find_header(req->input_headers, "Part-Offset"), &offset))
+            {
+                evhttp_send_reply(req, HTTP_BADREQUEST, "bad part number or Part-Offset", NULL);
+                return;
             }
+            SendSessionStatus(req, sessions_.WritePart(ctx.params.Get("id"), part_no, offset,
+                                                       evhttp_request_get_input_buffer(req)));
         }
 
-        static void Upload(struct evhttp_request *req, void *arg)
+        void SessionList(struct evhttp_request *req, RouteContext &ctx)
         {
-            mylog::GetLogger("asynclogger")->Info("Upload start");
+            Json::Value root;
+            SessionStatus status = sessions_.ListParts(ctx.params.Get("id"), &root);
+            if (status != SessionStatus::OK)
+            {
+                SendSessionStatus(req, status);
+                return;
+            }
+            SendJson(req, HTTP_OK, root);
+        }
+
+        void SessionAbort(struct evhttp_request *req, RouteContext &ctx)
+        {
+            SendSessionStatus(req, sessions_.Abort(ctx.params.Get("id")));
+        }
+
+        // 所有分片到齐后落盘，然后才把文件信息交给数据管理模块
+        void SessionComplete(struct evhttp_request *req, RouteContext &ctx)
+        {
+            std::string storage_path;
+            uint32_t crc = 0;
+            SessionStatus status = sessions_.Complete(ctx.params.Get("id"), &storage_path, &crc);
+            if (status != SessionStatus::OK)
+            {
+                SendSessionStatus(req, status);
+                return;
+            }
+            StorageInfo info;
+            if (info.NewStorageInfo(storage_path) == false)
+            {
+                SendSessionStatus(req, SessionStatus::INTERNAL);
+                return;
+            }
+            info.crc32c_ = crc;
+            info.has_crc32c_ = true;
+            data_->Insert(info);
+            MYLOG_LOGGER("asynclogger")->Info("upload session %s complete: %s", ctx.params.Get("id").c_str(), storage_path.c_str());
+            SendSessionStatus(req, SessionStatus::OK);
+        }
+
+        static void Upload(struct evhttp_request *req, RouteContext &ctx)
+        {
+            MYLOG_LOGGER("asynclogger")->Info("Upload start");
             // 约定：请求中包含"low_storage"，说明请求中存在文件数据,并希望普通存储\
                 包含"deep_storage"字段则压缩后存储
             // 获取请求体内容
             struct evbuffer *buf = evhttp_request_get_input_buffer(req);
             if (buf == nullptr)
             {
-                mylog::GetLogger("asynclogger")->Info("evhttp_request_get_input_buffer is empty");
+                MYLOG_LOGGER("asynclogger")->Info("evhttp_request_get_input_buffer is empty");
                 return;
             }
 
             size_t len = evbuffer_get_length(buf); // 获取请求体的长度
-            mylog::GetLogger("asynclogger")->Info("evbuffer_get_length is %u", len);
+            INFO_LIMITED(MYLOG_LOGGER("asynclogger"), "evbuffer_get_length is %u", len);
             if (0 == len)
             {
                 evhttp_send_reply(req, HTTP_BADREQUEST, "file empty", NULL);
-                mylog::GetLogger("asynclogger")->Info("request body is empty");
+                MYLOG_LOGGER("asynclogger")->Info("request body is empty");
                 return;
             }
+            // 逐块拷出请求体，同时计算CRC32C，数据块还在缓存里，不需要单独再扫一遍
             std::string content(len, 0);
-            if (-1 == evbuffer_copyout(buf, (void *)content.c_str(), len))
+            uint32_t crc = 0;
+            int chunks = evbuffer_peek(buf, -1, NULL, NULL, 0);
+            std::vector<struct evbuffer_iovec> vec(chunks);
+            evbuffer_peek(buf, -1, NULL, vec.data(), chunks);
+            size_t copied = 0;
+            for (auto &v : vec)
             {
-                mylog::GetLogger("asynclogger")->Error("evbuffer_copyout error");
-                evhttp_send_reply(req, HTTP_INTERNAL, NULL, NULL);
-                return;
+                memcpy(&content[copied], v.iov_base, v.iov_len);
+                crc = Crc32c::Extend(crc, v.iov_base, v.iov_len);
+                copied += v.iov_len;
             }
 
             // 获取文件名
@@ -157,7 +415,7 @@ namespace storage
             }
             else
             {
-                mylog::GetLogger("asynclogger")->Info("evhttp_send_reply: HTTP_BADREQUEST");
+                MYLOG_LOGGER("asynclogger")->Info("evhttp_send_reply: HTTP_BADREQUEST");
                 evhttp_send_reply(req, HTTP_BADREQUEST, "Illegal storage type", NULL);
                 return;
             }
@@ -169,7 +427,7 @@ namespace storage
             // 目录创建后加可以加上文件名，这个就是最终要写入的文件路径
             storage_path += filename;
 #ifdef DEBUG_LOG
-            mylog::GetLogger("asynclogger")->Debug("storage_path:%s", storage_path.c_str());
+            MYLOG_LOGGER("asynclogger")->Debug("storage_path:%s", storage_path.c_str());
 #endif
 
             // 看路径里是low还是deep存储，是deep就压缩，是low就直接写入
@@ -178,36 +436,38 @@ namespace storage
             {
                 if (fu.SetContent(content.c_str(), len) == false)
                 {
-                    mylog::GetLogger("asynclogger")->Error("low_storage fail, evhttp_send_reply: HTTP_INTERNAL");
+                    MYLOG_LOGGER("asynclogger")->Error("low_storage fail, evhttp_send_reply: HTTP_INTERNAL");
                     evhttp_send_reply(req, HTTP_INTERNAL, "server error", NULL);
                     return;
                 }
                 else
                 {
-                    mylog::GetLogger("asynclogger")->Info("low_storage success");
+                    MYLOG_LOGGER("asynclogger")->Info("low_storage success");
                 }
             }
             else
             {
                 if (fu.Compress(content, Config::GetInstance()->GetBundleFormat()) == false)
                 {
-                    mylog::GetLogger("asynclogger")->Error("deep_storage fail, evhttp_send_reply: HTTP_INTERNAL");
+                    MYLOG_LOGGER("asynclogger")->Error("deep_storage fail, evhttp_send_reply: HTTP_INTERNAL");
                     evhttp_send_reply(req, HTTP_INTERNAL, "server error", NULL);
                     return;
                 }
                 else
                 {
-                    mylog::GetLogger("asynclogger")->Info("deep_storage success");
+                    MYLOG_LOGGER("asynclogger")->Info("deep_storage success");
                 }
             }
 
             // 添加存储文件信息，交由数据管理类进行管理
             StorageInfo info;
             info.NewStorageInfo(storage_path); // 组织存储的文件信息
+            info.crc32c_ = crc;
+            info.has_crc32c_ = true;
             data_->Insert(info);               // 向数据管理模块添加存储的文件信息
 
             evhttp_send_reply(req, HTTP_OK, "Success", NULL);
-            mylog::GetLogger("asynclogger")->Info("upload finish:success");
+            MYLOG_LOGGER("asynclogger")->Info("upload finish:success");
         }
 
         static std::string TimetoStr(time_t t)
@@ -266,9 +526,9 @@ namespace storage
             ss << std::fixed << std::setprecision(2) << size << " " << units[unit_index];
             return ss.str();
         }
-        static void ListShow(struct evhttp_request *req, void *arg)
+        static void ListShow(struct evhttp_request *req, RouteContext &ctx)
         {
-            mylog::GetLogger("asynclogger")->Info("ListShow()");
+            MYLOG_LOGGER("asynclogger")->Info("ListShow()");
             // 1. 获取所有的文件存储信息
             std::vector<StorageInfo> arry;
             data_->GetAll(&arry);
@@ -295,10 +555,13 @@ namespace storage
             evbuffer_add(buf, (const void *)response_body.c_str(), response_body.size());
             evhttp_add_header(req->output_headers, "Content-Type", "text/html;charset=utf-8");
             evhttp_send_reply(req, HTTP_OK, NULL, NULL);
-            mylog::GetLogger("asynclogger")->Info("ListShow() finish");
+            MYLOG_LOGGER("asynclogger")->Info("ListShow() finish");
         }
         static std::string GetETag(const StorageInfo &info)
         {
+            // 有校验值时用内容校验值做强etag : "crc32c-fsize"
+            if (info.has_crc32c_)
+                return "\"" + Crc32c::ToHex(info.crc32c_) + "-" + std::to_string(info.fsize_) + "\"";
             // 自定义etag :  filename-fsize-mtime
             FileUtil fu(info.storage_path_);
             std::string etag = fu.FileName();
@@ -308,40 +571,63 @@ namespace storage
             etag += std::to_string(info.mtime_);
             return etag;
         }
-        static void Download(struct evhttp_request *req, void *arg)
+        static void Download(struct evhttp_request *req, RouteContext &ctx)
         {
-            // 1. 获取客户端请求的资源路径path   req.path
+            // 1. 获取客户端请求的资源路径path，路由阶段已经解码
             // 2. 根据资源路径，获取StorageInfo
             StorageInfo info;
-            std::string resource_path = evhttp_uri_get_path(evhttp_request_get_evhttp_uri(req));
-            resource_path = UrlDecode(resource_path);
-            data_->GetOneByURL(resource_path, &info);
-            mylog::GetLogger("asynclogger")->Info("request resource_path:%s", resource_path.c_str());
+            const std::string &resource_path = ctx.path;
+            MYLOG_LOGGER("asynclogger")->Info("request resource_path:%s", resource_path.c_str());
+            if (data_->GetOneByURL(resource_path, &info) == false)
+            {
+                MYLOG_LOGGER("asynclogger")->Info("evhttp_send_reply: 404 - %s not stored", ctx.params.Get("filename").c_str());
+                evhttp_send_reply(req, HTTP_NOTFOUND, "file not exists", NULL);
+                return;
+            }
 
             std::string download_path = info.storage_path_;
             // 2.如果压缩过了就解压到新文件给用户下载
             if (info.storage_path_.find(Config::GetInstance()->GetLowStorageDir()) == std::string::npos)
             {
-                mylog::GetLogger("asynclogger")->Info("uncompressing:%s", info.storage_path_.c_str());
+                MYLOG_LOGGER("asynclogger")->Info("uncompressing:%s", info.storage_path_.c_str());
                 FileUtil fu(info.storage_path_);
                 download_path = Config::GetInstance()->GetLowStorageDir() +
                                 std::string(download_path.begin() + download_path.find_last_of('/') + 1, download_path.end());
                 FileUtil dirCreate(Config::GetInstance()->GetLowStorageDir());
                 dirCreate.CreateDirectory();
-                fu.UnCompress(download_path); // 将文件解压到low_storage下去或者再创一个文件夹做中转
+                uint32_t crc = 0;
+                bool verify = info.has_crc32c_ && Config::GetInstance()->GetVerifyChecksum();
+                // 将文件解压到low_storage下去或者再创一个文件夹做中转
+                if (fu.UnCompress(download_path, verify ? &crc : nullptr) == false)
+                {
+                    // 读不出或解不开压缩文件，和内容校验不一致分开报告
+                    MYLOG_LOGGER("asynclogger")->Error("uncompress %s failed", info.storage_path_.c_str());
+                    remove(download_path.c_str());
+                    evhttp_send_reply(req, HTTP_INTERNAL, "decompression failed", NULL);
+                    return;
+                }
+                if (verify && crc != info.crc32c_)
+                {
+                    // 解压出来的内容和上传时不一致，说明存储的数据已经损坏
+                    MYLOG_LOGGER("asynclogger")->Error("crc32c mismatch: %s, expect %s, got %s", info.storage_path_.c_str(),
+                                                           Crc32c::ToHex(info.crc32c_).c_str(), Crc32c::ToHex(crc).c_str());
+                    remove(download_path.c_str());
+                    evhttp_send_reply(req, HTTP_INTERNAL, "checksum mismatch", NULL);
+                    return;
+                }
             }
-            mylog::GetLogger("asynclogger")->Info("request download_path:%s", download_path.c_str());
+            MYLOG_LOGGER("asynclogger")->Info("request download_path:%s", download_path.c_str());
             FileUtil fu(download_path);
             if (fu.Exists() == false && info.storage_path_.find("deep_storage") != std::string::npos)
             {
                 // 如果是压缩文件，且解压失败，是服务端的错误
-                mylog::GetLogger("asynclogger")->Info("evhttp_send_reply: 500 - UnCompress failed");
+                MYLOG_LOGGER("asynclogger")->Info("evhttp_send_reply: 500 - UnCompress failed");
                 evhttp_send_reply(req, HTTP_INTERNAL, NULL, NULL);
             }
             else if (fu.Exists() == false && info.storage_path_.find("low_storage") == std::string::npos)
             {
                 // 如果是普通文件，且文件不存在，是客户端的错误
-                mylog::GetLogger("asynclogger")->Info("evhttp_send_reply: 400 - bad request,file not exists");
+                MYLOG_LOGGER("asynclogger")->Info("evhttp_send_reply: 400 - bad request,file not exists");
                 evhttp_send_reply(req, HTTP_BADREQUEST, "file not exists", NULL);
             }
 
@@ -356,14 +642,14 @@ namespace storage
                 if (old_etag == GetETag(info))
                 {
                     retrans = true;
-                    mylog::GetLogger("asynclogger")->Info("%s need breakpoint continuous transmission", download_path.c_str());
+                    MYLOG_LOGGER("asynclogger")->Info("%s need breakpoint continuous transmission", download_path.c_str());
                 }
             }
 
             // 4. 读取文件数据，放入rsp.body中
             if (fu.Exists() == false)
             {
-                mylog::GetLogger("asynclogger")->Info("%s not exists", download_path.c_str());
+                MYLOG_LOGGER("asynclogger")->Info("%s not exists", download_path.c_str());
                 download_path += "not exists";
                 evhttp_send_reply(req, 404, download_path.c_str(), NULL);
                 return;
@@ -372,28 +658,33 @@ namespace storage
             int fd = open(download_path.c_str(), O_RDONLY);
             if (fd == -1)
             {
-                mylog::GetLogger("asynclogger")->Error("open file error: %s -- %s", download_path.c_str(), strerror(errno));
+                MYLOG_LOGGER("asynclogger")->Error("open file error: %s -- %s", download_path.c_str(), strerror(errno));
                 evhttp_send_reply(req, HTTP_INTERNAL, strerror(errno), NULL);
                 return;
             }
             // 和前面用的evbuffer_add类似，但是效率更高，具体原因可以看函数声明
             if (-1 == evbuffer_add_file(outbuf, fd, 0, fu.FileSize()))
             {
-                mylog::GetLogger("asynclogger")->Error("evbuffer_add_file: %d -- %s -- %s", fd, download_path.c_str(), strerror(errno));
+                MYLOG_LOGGER("asynclogger")->Error("evbuffer_add_file: %d -- %s -- %s", fd, download_path.c_str(), strerror(errno));
             }
             // 5. 设置响应头部字段： ETag， Accept-Ranges: bytes
             evhttp_add_header(req->output_headers, "Accept-Ranges", "bytes");
             evhttp_add_header(req->output_headers, "ETag", GetETag(info).c_str());
+            if (info.has_crc32c_)
+            {
+                std::string digest = "crc32c=" + base64_encode(Crc32c::ToBytes(info.crc32c_));
+                evhttp_add_header(req->output_headers, "Digest", digest.c_str());
+            }
             evhttp_add_header(req->output_headers, "Content-Type", "application/octet-stream");
             if (retrans == false)
             {
                 evhttp_send_reply(req, HTTP_OK, "Success", NULL);
-                mylog::GetLogger("asynclogger")->Info("evhttp_send_reply: HTTP_OK");
+                INFO_LIMITED(MYLOG_LOGGER("asynclogger"), "evhttp_send_reply: HTTP_OK");
             }
             else
             {
                 evhttp_send_reply(req, 206, "breakpoint continuous transmission", NULL); // 区间请求响应的是206
-                mylog::GetLogger("asynclogger")->Info("evhttp_send_reply: 206");
+                INFO_LIMITED(MYLOG_LOGGER("asynclogger"), "evhttp_send_reply: 206");
             }
             if (download_path != info.storage_path_)
             {
@@ -10,7 +10,7 @@ mylog::Util::JsonData* g_conf_data;
 void service_module()
 {
     storage::Service s;
-    mylog::GetLogger("asynclogger")->Info("service step in RunModule");
+    MYLOG_LOGGER("asynclogger")->Info("service step in RunModule");
     s.RunModule();
 }
 
@@ -0,0 +1,413 @@
+#pragma once
+#include "DataManager.hpp"
+
+#include <event2/buffer.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 分片/断点续传上传会话
+// 流程: 创建会话(返回id) -> 并行 PUT 各分片(带偏移) -> 查询已收到的分片 -> 完成/放弃
+// 分片用 pwrite 直接写进会话的暂存文件(已知总大小时预先分配)，完成时再落到 low/deep 目录
+// 只有完成时才写入元数据，长时间没有活动的会话由定时器回收
+namespace storage
+{
+    enum class SessionStatus
+    {
+        OK,
+        NOT_FOUND,
+        BAD_REQUEST,
+        CONFLICT,
+        INTERNAL
+    };
+
+    class UploadSessionManager
+    {
+    public:
+        struct Part
+        {
+            uint64_t offset;
+            uint64_t size;
+            uint32_t crc32c; // 分片内容的校验值，完成时按偏移顺序合并
+        };
+
+        UploadSessionManager()
+        {
+            Config *config = Config::GetInstance();
+            session_dir_ = config->GetUploadSessionDir();
+            ttl_sec_ = config->GetUploadSessionTtlSec();
+            max_parts_ = config->GetUploadMaxParts();
+            max_size_ = config->GetUploadMaxSize();
+            max_deep_size_ = config->GetUploadMaxDeepSize();
+            FileUtil dir(session_dir_);
+            dir.CreateDirectory();
+            // 会话只保存在内存中，重启后遗留的暂存文件已经无法完成，直接清理
+            std::vector<std::string> leftovers;
+            dir.ScanDirectory(&leftovers);
+            for (auto &file : leftovers)
+                remove(file.c_str());
+        }
+
+        ~UploadSessionManager()
+        {
+            for (auto &it : sessions_)
+                close(it.second.fd);
+        }
+
+        // 创建会话，total_size 为0表示总大小未知
+        SessionStatus Create(const std::string &filename, const std::string &storage_type,
+                             uint64_t total_size, std::string *id)
+        {
+            if (filename.empty() || filename.find('/') != std::string::npos || filename == "." || filename == "..")
+                return SessionStatus::BAD_REQUEST;
+            if (storage_type != "low" && storage_type != "deep")
+                return SessionStatus::BAD_REQUEST;
+            // 深度存储完成时要把整个文件读进内存压缩，单独限制大小
+            uint64_t max_size = storage_type == "deep" ? std::min(max_size_, max_deep_size_) : max_size_;
+            if (total_size > max_size)
+                return SessionStatus::BAD_REQUEST;
+
+            std::unique_lock<std::mutex> lock(mtx_);
+            Session s;
+            s.id = NewId();
+            s.filename = filename;
+            s.storage_type = storage_type;
+            s.total_size = total_size;
+            s.max_size = max_size;
+            s.data_path = session_dir_ + s.id + ".part";
+            s.fd = open(s.data_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (s.fd == -1)
+            {
+                MYLOG_LOGGER("asynclogger")->Error("open session file %s failed: %s", s.data_path.c_str(), strerror(errno));
+                return SessionStatus::INTERNAL;
+            }
+            if (total_size > 0)
+            {
+                int ret = posix_fallocate(s.fd, 0, total_size);
+                if (ret != 0)
+                {
+                    MYLOG_LOGGER("asynclogger")->Error("fallocate %s failed: %s", s.data_path.c_str(), strerror(ret));
+                    close(s.fd);
+                    remove(s.data_path.c_str());
+                    return SessionStatus::INTERNAL;
+                }
+            }
+            s.last_active = time(nullptr);
+            *id = s.id;
+            sessions_.emplace(s.id, std::move(s));
+            return SessionStatus::OK;
+        }
+
+        // 把 buf 中的数据作为第 part_no 个分片写到 offset 处，同一分片重复上传会覆盖
+        SessionStatus WritePart(const std::string &id, uint32_t part_no, uint64_t offset, struct evbuffer *buf)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            auto it = sessions_.find(id);
+            if (it == sessions_.end())
+                return SessionStatus::NOT_FOUND;
+            Session &s = it->second;
+            if (s.completing)
+                return SessionStatus::CONFLICT;
+            uint64_t size = evbuffer_get_length(buf);
+            if (size == 0 || part_no >= max_parts_)
+                return SessionStatus::BAD_REQUEST;
+            // 先排除 offset + size 溢出，否则回绕后的小值能绕过下面的大小和重叠检查
+            if (offset > s.max_size || size > s.max_size - offset)
+                return SessionStatus::BAD_REQUEST;
+            if (s.total_size > 0 && offset + size > s.total_size)
+                return SessionStatus::BAD_REQUEST;
+            for (auto &p : s.parts)
+            {
+                if (p.first == part_no)
+                    continue;
+                if (offset < p.second.offset + p.second.size && p.second.offset < offset + size)
+                    return SessionStatus::CONFLICT; // 与其他分片重叠
+            }
+
+            // 直接从evbuffer的各个内存块写文件，不再拷贝一份
+            int n = evbuffer_peek(buf, -1, NULL, NULL, 0);
+            std::vector<struct evbuffer_iovec> vec(n);
+            evbuffer_peek(buf, -1, NULL, vec.data(), n);
+            uint64_t pos = offset;
+            uint32_t crc = 0;
+            for (auto &v : vec)
+            {
+                const char *data = static_cast<const char *>(v.iov_base);
+                size_t left = v.iov_len;
+                crc = Crc32c::Extend(crc, data, left);
+                while (left > 0)
+                {
+                    ssize_t w = pwrite(s.fd, data, left, pos);
+                    if (w < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        MYLOG_LOGGER("asynclogger")->Error("pwrite %s failed: %s", s.data_path.c_str(), strerror(errno));
+                        return SessionStatus::INTERNAL;
+                    }
+                    data += w;
+                    left -= w;
+                    pos += w;
+                }
+            }
+            s.parts[part_no] = Part{offset, size, crc};
+            s.last_active = time(nullptr);
+            return SessionStatus::OK;
+        }
+
+        SessionStatus ListParts(const std::string &id, Json::Value *out)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            auto it = sessions_.find(id);
+            if (it == sessions_.end())
+                return SessionStatus::NOT_FOUND;
+            const Session &s = it->second;
+            uint64_t received = 0;
+            (*out)["upload_id"] = s.id;
+            (*out)["filename"] = s.filename;
+            (*out)["storage_type"] = s.storage_type;
+            (*out)["total_size"] = (Json::UInt64)s.total_size;
+            Json::Value &parts = (*out)["parts"];
+            parts = Json::Value(Json::arrayValue);
+            for (auto &p : s.parts)
+            {
+                Json::Value item;
+                item["part"] = p.first;
+                item["offset"] = (Json::UInt64)p.second.offset;
+                item["size"] = (Json::UInt64)p.second.size;
+                item["crc32c"] = Crc32c::ToHex(p.second.crc32c);
+                parts.append(item);
+                received += p.second.size;
+            }
+            (*out)["received_bytes"] = (Json::UInt64)received;
+            return SessionStatus::OK;
+        }
+
+        // 检查分片是否连续覆盖整个文件，然后落到存储目录
+        // storage_path 带回最终路径，crc 带回由各分片合并得到的整个文件的CRC32C
+        SessionStatus Complete(const std::string &id, std::string *storage_path, uint32_t *crc)
+        {
+            Session *s;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                auto it = sessions_.find(id);
+                if (it == sessions_.end())
+                    return SessionStatus::NOT_FOUND;
+                if (it->second.completing)
+                    return SessionStatus::CONFLICT;
+                // 按偏移排序后检查有没有空洞
+                std::map<uint64_t, const Part *> ranges;
+                for (auto &p : it->second.parts)
+                    ranges[p.second.offset] = &p.second;
+                uint64_t end = 0;
+                *crc = 0;
+                for (auto &r : ranges)
+                {
+                    if (r.first != end)
+                        return SessionStatus::CONFLICT;
+                    end += r.second->size;
+                    *crc = Crc32c::Combine(*crc, r.second->crc32c, r.second->size);
+                }
+                if (end == 0 || (it->second.total_size > 0 && end != it->second.total_size))
+                    return SessionStatus::CONFLICT;
+                // 落盘期间会话留在表里，但不再接受分片、放弃和回收；失败后客户端可以重试完成
+                s = &it->second;
+                s->completing = true;
+                s->final_size = end;
+            }
+
+            SessionStatus ret = Finalize(*s, storage_path);
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (ret != SessionStatus::OK)
+            {
+                s->completing = false;
+                s->last_active = time(nullptr);
+                return ret;
+            }
+            Drop(*s);
+            sessions_.erase(s->id);
+            return ret;
+        }
+
+        SessionStatus Abort(const std::string &id)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            auto it = sessions_.find(id);
+            if (it == sessions_.end())
+                return SessionStatus::NOT_FOUND;
+            if (it->second.completing)
+                return SessionStatus::CONFLICT;
+            Drop(it->second);
+            sessions_.erase(it);
+            return SessionStatus::OK;
+        }
+
+        // 已收到的字节数，用于准入控制估算完成阶段要处理的字节数
+        uint64_t ReceivedBytes(const std::string &id)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            auto it = sessions_.find(id);
+            if (it == sessions_.end())
+                return 0;
+            uint64_t received = 0;
+            for (auto &p : it->second.parts)
+                received += p.second.size;
+            return received;
+        }
+
+        // 回收超过 ttl 没有活动的会话
+        void CollectGarbage()
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            time_t now = time(nullptr);
+            for (auto it = sessions_.begin(); it != sessions_.end();)
+            {
+                if (it->second.completing || now - it->second.last_active < ttl_sec_)
+                {
+                    ++it;
+                    continue;
+                }
+                MYLOG_LOGGER("asynclogger")->Info("upload session %s expired", it->first.c_str());
+                Drop(it->second);
+                it = sessions_.erase(it);
+            }
+        }
+
+    private:
+        struct Session
+        {
+            std::string id;
+            std::string filename;
+            std::string storage_type;
+            std::string data_path; // 暂存文件
+            int fd = -1;
+            uint64_t total_size = 0;
+            uint64_t max_size = 0; // 分片不能超出的位置
+            std::map<uint32_t, Part> parts; // 分片号 -> 位置
+            time_t last_active = 0;
+            bool completing = false; // 正在落盘，期间表里的这一项不会被删除
+            uint64_t final_size = 0; // 各分片覆盖的实际大小
+        };
+
+        SessionStatus Finalize(Session &s, std::string *storage_path)
+        {
+            Config *config = Config::GetInstance();
+            // 并行写入时可能先写到了后面的偏移，截断到实际大小
+            if (ftruncate(s.fd, s.final_size) == -1)
+            {
+                MYLOG_LOGGER("asynclogger")->Error("ftruncate %s failed: %s", s.data_path.c_str(), strerror(errno));
+                return SessionStatus::INTERNAL;
+            }
+
+            std::string dir = s.storage_type == "low" ? config->GetLowStorageDir() : config->GetDeepStorageDir();
+            FileUtil dir_create(dir);
+            dir_create.CreateDirectory();
+            *storage_path = dir + s.filename;
+
+            if (s.storage_type == "low")
+            {
+                // 同一文件系统下直接改名，不用再拷贝数据
+                if (rename(s.data_path.c_str(), storage_path->c_str()) == 0)
+                    return SessionStatus::OK;
+                MYLOG_LOGGER("asynclogger")->Info("rename %s failed: %s, fall back to copy", s.data_path.c_str(), strerror(errno));
+                return CopyStaged(s, *storage_path) ? SessionStatus::OK : SessionStatus::INTERNAL;
+            }
+
+            // 深度存储的会话大小受 upload_max_deep_size 限制，可以整个读进内存压缩
+            std::string content;
+            FileUtil staged(s.data_path);
+            if (staged.GetContent(&content) == false)
+                return SessionStatus::INTERNAL;
+            FileUtil fu(*storage_path);
+            return fu.Compress(content, config->GetBundleFormat()) ? SessionStatus::OK : SessionStatus::INTERNAL;
+        }
+
+        // 改名失败(跨文件系统)时分块拷贝，不把整个文件读进内存
+        bool CopyStaged(const Session &s, const std::string &dst)
+        {
+            int out = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (out == -1)
+            {
+                MYLOG_LOGGER("asynclogger")->Error("open %s failed: %s", dst.c_str(), strerror(errno));
+                return false;
+            }
+            std::vector<char> buf(1 << 20);
+            uint64_t pos = 0;
+            bool ok = true;
+            while (ok && pos < s.final_size)
+            {
+                ssize_t n = pread(s.fd, buf.data(), std::min<uint64_t>(buf.size(), s.final_size - pos), pos);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    MYLOG_LOGGER("asynclogger")->Error("read %s failed: %s", s.data_path.c_str(), n < 0 ? strerror(errno) : "short file");
+                    ok = false;
+                    break;
+                }
+                for (ssize_t done = 0; done < n;)
+                {
+                    ssize_t w = write(out, buf.data() + done, n - done);
+                    if (w < 0 && errno == EINTR)
+                        continue;
+                    if (w < 0)
+                    {
+                        MYLOG_LOGGER("asynclogger")->Error("write %s failed: %s", dst.c_str(), strerror(errno));
+                        ok = false;
+                        break;
+                    }
+                    done += w;
+                }
+                pos += n;
+            }
+            if (close(out) != 0)
+                ok = false;
+            if (!ok)
+                remove(dst.c_str());
+            return ok;
+        }
+
+        void Drop(Session &s)
+        {
+            close(s.fd);
+            remove(s.data_path.c_str());
+        }
+
+        std::string NewId()
+        {
+            static const char hex[] = "0123456789abcdef";
+            std::string id;
+            do
+            {
+                id.clear();
+                for (int i = 0; i < 2; ++i)
+                {
+                    uint64_t r = rng_();
+                    for (int j = 0; j < 16; ++j, r >>= 4)
+                        id += hex[r & 0xf];
+                }
+            } while (sessions_.count(id));
+            return id;
+        }
+
+    private:
+        std::mutex mtx_;
+        std::string session_dir_;
+        time_t ttl_sec_;
+        uint32_t max_parts_;
+        uint64_t max_size_;
+        uint64_t max_deep_size_;
+        std::mt19937_64 rng_{std::random_device{}()};
+        std::unordered_map<std::string, Session> sessions_;
+    };
+}
@@ -1,10 +1,12 @@
 #pragma once
 #include "jsoncpp/json/json.h"
 #include <cassert>
+#include <cctype>
 #include <sstream>
 #include <memory>
 #include "bundle.h"
 #include "Config.hpp"
+#include "Checksum.hpp"
 #include <iostream>
 #include <experimental/filesystem>
 #include <string>
@@ -17,12 +19,12 @@ namespace storage
 {
     namespace fs = std::experimental::filesystem;
 
-    static unsigned char ToHex(unsigned char x)
+    inline unsigned char ToHex(unsigned char x)
     {
         return x > 9 ? x + 55 : x + 48;
     }
 
-    static unsigned char FromHex(unsigned char x)
+    inline unsigned char FromHex(unsigned char x)
     {
         unsigned char y;
         if (x >= 'A' && x <= 'Z')
@@ -35,7 +37,7 @@ namespace storage
             assert(0);
         return y;
     }
-    static std::string UrlDecode(const std::string &str)
+    inline std::string UrlDecode(const std::string &str)
     {
         std::string strTemp = "";
         size_t length = str.length();
@@ -55,6 +57,27 @@ namespace storage
         }
         return strTemp;
     }
+    // 校验版本：遇到不完整或非法的%编码返回false，不会触发assert
+    inline bool UrlDecode(const std::string &str, std::string *out)
+    {
+        out->clear();
+        out->reserve(str.size());
+        size_t length = str.length();
+        for (size_t i = 0; i < length; i++)
+        {
+            if (str[i] != '%')
+            {
+                *out += str[i];
+                continue;
+            }
+            if (i + 2 >= length || !isxdigit((unsigned char)str[i + 1]) || !isxdigit((unsigned char)str[i + 2]))
+                return false;
+            unsigned char high = FromHex((unsigned char)str[++i]);
+            unsigned char low = FromHex((unsigned char)str[++i]);
+            *out += high * 16 + low;
+        }
+        return true;
+    }
 
     class FileUtil
     {
@@ -71,7 +94,7 @@ namespace storage
             auto ret = stat(filename_.c_str(), &s);
             if (ret == -1)
             {
-                mylog::GetLogger("asynclogger")->Info("%s, Get file size failed: %s", filename_.c_str(),strerror(errno));
+                MYLOG_LOGGER("asynclogger")->Info("%s, Get file size failed: %s", filename_.c_str(),strerror(errno));
                 return -1;
             }
             return s.st_size;
@@ -83,7 +106,7 @@ namespace storage
             auto ret = stat(filename_.c_str(), &s);
             if (ret == -1)
             {
-                mylog::GetLogger("asynclogger")->Info("%s, Get file access time failed: %s", filename_.c_str(),strerror(errno));
+                MYLOG_LOGGER("asynclogger")->Info("%s, Get file access time failed: %s", filename_.c_str(),strerror(errno));
                 return -1;
             }
             return s.st_atime;
@@ -96,7 +119,7 @@ namespace storage
             auto ret = stat(filename_.c_str(), &s);
             if (ret == -1)
             {
-                mylog::GetLogger("asynclogger")->Info("%s, Get file modify time failed: %s",filename_.c_str(), strerror(errno));
+                MYLOG_LOGGER("asynclogger")->Info("%s, Get file modify time failed: %s",filename_.c_str(), strerror(errno));
                 return -1;
             }
             return s.st_mtime;
@@ -117,7 +140,7 @@ namespace storage
             // 判断要求数据内容是否符合文件大小
             if (pos + len > FileSize())
             {
-                mylog::GetLogger("asynclogger")->Info("needed data larger than file size");
+                MYLOG_LOGGER("asynclogger")->Info("needed data larger than file size");
                 return false;
             }
 
@@ -126,7 +149,7 @@ namespace storage
             ifs.open(filename_.c_str(), std::ios::binary);
             if (ifs.is_open() == false)
             {
-                mylog::GetLogger("asynclogger")->Info("%s,file open error",filename_.c_str());
+                MYLOG_LOGGER("asynclogger")->Info("%s,file open error",filename_.c_str());
                 return false;
             }
 
@@ -136,7 +159,7 @@ namespace storage
             ifs.read(&(*content)[0], len);
             if (!ifs.good())
             {
-                mylog::GetLogger("asynclogger")->Info("%s,read file content error",filename_.c_str());
+                MYLOG_LOGGER("asynclogger")->Info("%s,read file content error",filename_.c_str());
                 ifs.close();
                 return false;
             }
@@ -158,13 +181,13 @@ namespace storage
             ofs.open(filename_.c_str(), std::ios::binary);
             if (!ofs.is_open())
             {
-                mylog::GetLogger("asynclogger")->Info("%s open error: %s", filename_.c_str(), strerror(errno));
+                MYLOG_LOGGER("asynclogger")->Info("%s open error: %s", filename_.c_str(), strerror(errno));
                 return false;
             }
             ofs.write(content, len);
             if (!ofs.good())
             {
-                mylog::GetLogger("asynclogger")->Info("%s, file set content error",filename_.c_str());
+                MYLOG_LOGGER("asynclogger")->Info("%s, file set content error",filename_.c_str());
                 ofs.close();
             }
             ofs.close();
@@ -179,34 +202,43 @@ namespace storage
             std::string packed = bundle::pack(format, content);
             if (packed.size() == 0)
             {
-                mylog::GetLogger("asynclogger")->Info("Compress packed size error:%d", packed.size());
+                MYLOG_LOGGER("asynclogger")->Info("Compress packed size error:%d", packed.size());
                 return false;
             }
             // 将压缩的数据写入压缩包文件中
             FileUtil f(filename_);
             if (f.SetContent(packed.c_str(), packed.size()) == false)
             {
-                mylog::GetLogger("asynclogger")->Info("filename:%s, Compress SetContent error",filename_.c_str());
+                MYLOG_LOGGER("asynclogger")->Info("filename:%s, Compress SetContent error",filename_.c_str());
                 return false;
             }
             return true;
         }
-        bool UnCompress(std::string &download_path)
+        // crc 不为空时顺带计算解压后内容的CRC32C，数据已经在内存里，不需要额外读一遍文件
+        bool UnCompress(std::string &download_path, uint32_t *crc = nullptr)
         {
             // 将当前压缩包数据读取出来
             std::string body;
             if (this->GetContent(&body) == false)
             {
-                mylog::GetLogger("asynclogger")->Info("filename:%s, uncompress get file content failed!",filename_.c_str());
+                MYLOG_LOGGER("asynclogger")->Info("filename:%s, uncompress get file content failed!",filename_.c_str());
                 return false;
             }
             // 对压缩的数据进行解压缩
             std::string unpacked = bundle::unpack(body);
+            // 上传不接受空文件，解不出内容说明压缩数据已经损坏
+            if (unpacked.empty())
+            {
+                MYLOG_LOGGER("asynclogger")->Info("filename:%s, uncompress failed!",filename_.c_str());
+                return false;
+            }
+            if (crc != nullptr)
+                *crc = Crc32c::Extend(0, unpacked.data(), unpacked.size());
             // 将解压缩的数据写入到新文件
             FileUtil fu(download_path);
             if (fu.SetContent(unpacked.c_str(), unpacked.size()) == false)
             {
-                mylog::GetLogger("asynclogger")->Info("filename:%s, uncompress write packed data failed!",filename_.c_str());
+                MYLOG_LOGGER("asynclogger")->Info("filename:%s, uncompress write packed data failed!",filename_.c_str());
                 return false;
             }
             return true;
@@ -250,7 +282,7 @@ namespace storage
             std::stringstream ss;
             if (usw->write(val, &ss) != 0)
             {
-                mylog::GetLogger("asynclogger")->Info("serialize error");
+                MYLOG_LOGGER("asynclogger")->Info("serialize error");
                 return false;
             }
             *str = ss.str();
@@ -264,7 +296,7 @@ namespace storage
             std::string err;
             if (ucr->parse(str.c_str(), str.c_str() + str.size(), val, &err) == false)
             {
-                mylog::GetLogger("asynclogger")->Info("parse error");
+                MYLOG_LOGGER("asynclogger")->Info("parse error");
                 return false;
             }
             return false;
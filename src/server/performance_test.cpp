@@ -1,15 +1,62 @@
 #include "../../log_system/logs_code/MyLog.hpp"
 #include "../../log_system/logs_code/Util.hpp"
+#include "../../log_system/logs_code/Formatter.hpp"
+#include "../../log_system/logs_code/backlog/BackupProtocol.hpp"
+#include "../../log_system/logs_code/backlog/BackupSpool.hpp"
+#include "Router.hpp"
+#include "Config.hpp"
 #include <iostream>
 #include <thread>
 #include <vector>
 #include <chrono>
 #include <atomic>
 #include <sstream>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+
+// 统计堆分配次数，用来衡量每条日志引起的分配
+static std::atomic<size_t> g_alloc_count(0);
+
+// 替换了 new 就要把 new[]、nothrow 和对应的 delete 一并替换，否则分配和释放可能不配对
+static void* CountedAlloc(size_t size) noexcept
+{
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size != 0 ? size : 1);
+}
+
+// 不内联：delete 内联成 free 后，g++ 会把 new 表达式和 free 当成不配对(-Wmismatched-new-delete)
+__attribute__((noinline)) static void CountedFree(void* p) noexcept
+{
+    free(p);
+}
+
+void* operator new(size_t size)
+{
+    if (void* p = CountedAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size)
+{
+    if (void* p = CountedAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size); }
+void operator delete(void* p) noexcept { CountedFree(p); }
+void operator delete[](void* p) noexcept { CountedFree(p); }
+void operator delete(void* p, size_t) noexcept { CountedFree(p); }
+void operator delete[](void* p, size_t) noexcept { CountedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { CountedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { CountedFree(p); }
 
 // 全局变量，用于初始化日志系统
 // ThreadPool* tp = nullptr; 
 mylog::Util::JsonData* g_conf_data;
+std::shared_ptr<mylog::RollFileFlush> g_text_flush; // 保留引用，测试结束后输出同步统计
+std::shared_ptr<mylog::MmapFileFlush> g_mmap_flush;
 
 void log_system_module_init()
 {
@@ -17,52 +64,568 @@ void log_system_module_init()
     
     std::shared_ptr<mylog::LoggerBuilder> builder(new mylog::LoggerBuilder());
     builder->BuildLoggerName("performance_logger");
-    builder->BuildLoggerFlush<mylog::RollFileFlush>("./perftest_log/test.log", 1024 * 1024 * 500);
+    g_text_flush = std::make_shared<mylog::RollFileFlush>("./perftest_log/test.log", 1024 * 1024 * 500);
+    builder->BuildLoggerFlush(g_text_flush);
+    // 压测要求一条不丢，积压满了让生产者等待
+    builder->BuildOverflowPolicy(mylog::OverflowPolicy::BLOCK);
     
     mylog::LoggerManager::GetInstance().AddLogger(builder->Build());
+
+    // 二进制模式的日志器，落地文件用 mylog_decode 查看
+    std::shared_ptr<mylog::LoggerBuilder> bin_builder(new mylog::LoggerBuilder());
+    bin_builder->BuildLoggerName("performance_logger_bin");
+    bin_builder->BuildBinaryMode();
+    bin_builder->BuildLoggerFlush<mylog::RollFileFlush>("./perftest_log/test.bin", 1024 * 1024 * 500);
+    bin_builder->BuildOverflowPolicy(mylog::OverflowPolicy::BLOCK);
+    mylog::LoggerManager::GetInstance().AddLogger(bin_builder->Build());
+
+    // 文本格式，落地到内存映射的分段文件，和 performance_logger 对比落地方式的差别
+    std::shared_ptr<mylog::LoggerBuilder> mmap_builder(new mylog::LoggerBuilder());
+    mmap_builder->BuildLoggerName("performance_logger_mmap");
+    mmap_builder->BuildOverflowPolicy(mylog::OverflowPolicy::BLOCK);
+    g_mmap_flush = std::make_shared<mylog::MmapFileFlush>("./perftest_log/test.mmap", 64 * 1024 * 1024);
+    mmap_builder->BuildLoggerFlush(g_mmap_flush);
+    mylog::LoggerManager::GetInstance().AddLogger(mmap_builder->Build());
 }
 
-void worker_thread(mylog::AsyncLogger::ptr logger, size_t num_logs_to_write, std::atomic<size_t>& total_logs)
+void worker_thread(mylog::AsyncLogger::ptr logger, size_t num_logs_to_write, std::atomic<size_t>& total_logs, bool binary)
 {
     std::stringstream ss;
     ss << std::this_thread::get_id();
     uint64_t thread_id_uint = std::stoull(ss.str());
 
     for (size_t i = 0; i < num_logs_to_write; ++i) {
-
-        logger->Info("Performance test log message #%zu from thread %llu", i, thread_id_uint);
+        if (binary) {
+            LOGBININFO(logger, "Performance test log message #%zu from thread %llu", i, thread_id_uint);
+        } else {
+            logger->Info("Performance test log message #%zu from thread %llu", i, thread_id_uint);
+        }
     }
     
     total_logs.fetch_add(num_logs_to_write, std::memory_order_relaxed);
 }
 
+// 改造前 LogMessage::format 的实现，作为格式化微基准的对照
+std::string legacy_format(const mylog::LogMessage& msg)
+{
+    std::stringstream ret;
+    struct tm t;
+    localtime_r(&msg.ctime_, &t);
+    char buf[128];
+    strftime(buf, sizeof(buf), "%H:%M:%S", &t);
+    std::string tmp1 = '[' + std::string(buf) + "][";
+    std::string tmp2 = "][" + std::string(mylog::LogLevel::ToString(msg.level_)) + "][" + msg.name_ + "][" + msg.file_name_ + ":" + std::to_string(msg.line_) + "]\t" + std::string(msg.Payload()) + "\n";
+    ret << tmp1 << msg.tid_ << tmp2;
+    return ret.str();
+}
+
+// 只测单线程格式化一行的耗时，不经过流水线
+int format_benchmark(size_t iterations)
+{
+    mylog::LogMessage msg(mylog::LogLevel::value::INFO, "performance_test.cpp", 42, "performance_logger",
+                          "Performance test log message #123456 from thread 140200046171840");
+    mylog::Formatter formatter;
+    if (formatter.Format(msg) != legacy_format(msg)) {
+        std::cerr << "Formatter output differs from the legacy format" << std::endl;
+        return 1;
+    }
+
+    size_t sink = 0;
+    size_t alloc_start = g_alloc_count.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += legacy_format(msg).size();
+    }
+    auto mid = std::chrono::steady_clock::now();
+    size_t alloc_mid = g_alloc_count.load();
+    std::string out;
+    for (size_t i = 0; i < iterations; ++i) {
+        out.clear(); // 复用同一个缓冲区
+        formatter.Format(msg, &out);
+        sink += out.size();
+    }
+    auto end = std::chrono::steady_clock::now();
+    size_t alloc_end = g_alloc_count.load();
+
+    double legacy_ns = std::chrono::duration<double, std::nano>(mid - start).count() / iterations;
+    double compiled_ns = std::chrono::duration<double, std::nano>(end - mid).count() / iterations;
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Format benchmark (" << iterations << " lines, checksum " << sink << ")" << std::endl;
+    std::cout << "Legacy stringstream format: " << legacy_ns << " ns/line, "
+              << double(alloc_mid - alloc_start) / iterations << " allocations/line" << std::endl;
+    std::cout << "Compiled pattern format:    " << compiled_ns << " ns/line, "
+              << double(alloc_end - alloc_mid) / iterations << " allocations/line" << std::endl;
+    std::cout << "Speedup: " << legacy_ns / compiled_ns << "x" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    return 0;
+}
+
+// 改造前 Handle 的做法：先用空缓冲区算长度，再分配字符串格式化第二遍
+void legacy_payload(std::string* out, const char* format, ...)
+{
+    va_list va, va_copy;
+    va_start(va, format);
+    va_copy(va_copy, va);
+    int len = vsnprintf(nullptr, 0, format, va_copy);
+    va_end(va_copy);
+    std::string data(len, '\0');
+    vsnprintf(&data[0], len + 1, format, va);
+    va_end(va);
+    *out = std::move(data);
+}
+
+// 先写记录内联区，超过内联区再按长度格式化第二遍
+void inline_first_payload(mylog::LogMessage* msg, const char* format, ...)
+{
+    va_list va, va_copy;
+    va_start(va, format);
+    va_copy(va_copy, va);
+    int len = vsnprintf(msg->PayloadBuffer(0), mylog::LogMessage::kInlinePayload, format, va_copy);
+    va_end(va_copy);
+    if (static_cast<size_t>(len) >= mylog::LogMessage::kInlinePayload) {
+        vsnprintf(msg->PayloadBuffer(len), len + 1, format, va);
+    }
+    msg->SetPayloadSize(len);
+    va_end(va);
+}
+
+// 当前的做法：线程私有缓冲区一遍格式化，再拷进记录
+void thread_buffer_payload(mylog::LogMessage* msg, const char* format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    msg->FormatPayload(format, va);
+    va_end(va);
+}
+
+// 不同正文长度下三种正文格式化方式的单线程耗时
+int payload_benchmark(size_t iterations)
+{
+    const size_t sizes[] = {32, 128, 256, 1024, 3000, 8000};
+    mylog::LogMessage msg;
+    std::string legacy_out;
+    size_t sink = 0;
+
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Payload format benchmark (" << iterations << " lines per size, ns/line)" << std::endl;
+    std::cout << "size\ttwo-pass\tinline-first\tthread-buffer" << std::endl;
+    for (size_t size : sizes) {
+        // 正文 = 填充文本 + 两个整数，总长约为 size
+        std::string filler(size > 40 ? size - 40 : 1, 'x');
+        const char* fmt = "%s #%zu from thread %llu";
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            legacy_payload(&legacy_out, fmt, filler.c_str(), i, 140200046171840ULL);
+            sink += legacy_out.size();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            inline_first_payload(&msg, fmt, filler.c_str(), i, 140200046171840ULL);
+            sink += msg.Payload().size();
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            thread_buffer_payload(&msg, fmt, filler.c_str(), i, 140200046171840ULL);
+            sink += msg.Payload().size();
+        }
+        auto t3 = std::chrono::steady_clock::now();
+
+        auto per_line = [iterations](std::chrono::steady_clock::duration d) {
+            return std::chrono::duration<double, std::nano>(d).count() / iterations;
+        };
+        std::cout << msg.Payload().size() << "\t" << per_line(t1 - t0) << "\t\t" << per_line(t2 - t1)
+                  << "\t\t" << per_line(t3 - t2) << std::endl;
+    }
+    std::cout << "checksum " << sink << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    return 0;
+}
+
+// 结构化日志和 printf 日志的对比：调用线程上生成正文的耗时，以及格式化线程渲染整行的耗时
+int structured_benchmark(size_t iterations)
+{
+    mylog::LogMessage text_msg, kv_msg;
+    mylog::Formatter formatter;
+    std::string path = "/storage/deep/upload_2f9a/report-2024.pdf", out;
+    size_t bytes = 1048576;
+    int status = 200;
+    double elapsed = 12.5;
+    size_t sink = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        text_msg.Init(mylog::LogLevel::value::INFO, __FILE__, __LINE__, "performance_logger");
+        thread_buffer_payload(&text_msg, "upload path:%s,bytes:%zu,status:%d,elapsed:%f", path.c_str(), bytes + i,
+                              status, elapsed);
+        sink += text_msg.Payload().size();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        kv_msg.Init(mylog::LogLevel::value::INFO, __FILE__, __LINE__, "performance_logger");
+        kv_msg.structured_ = true;
+        size_t size = mylog::StructuredFields::EncodedSize("upload", mylog::kv("path", path), mylog::kv("bytes", bytes + i),
+                                                           mylog::kv("status", status), mylog::kv("elapsed", elapsed));
+        mylog::StructuredFields::Encode(kv_msg.PayloadBuffer(size), "upload", mylog::kv("path", path),
+                                        mylog::kv("bytes", bytes + i), mylog::kv("status", status),
+                                        mylog::kv("elapsed", elapsed));
+        kv_msg.SetPayloadSize(size);
+        sink += kv_msg.Payload().size();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        out.clear();
+        formatter.Format(text_msg, &out);
+        sink += out.size();
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        out.clear();
+        formatter.Format(kv_msg, &out);
+        sink += out.size();
+    }
+    auto t4 = std::chrono::steady_clock::now();
+
+    auto per_line = [iterations](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::nano>(d).count() / iterations;
+    };
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Structured logging benchmark (" << iterations << " lines, ns/line)" << std::endl;
+    std::cout << "\t\tcapture\trender" << std::endl;
+    std::cout << "printf\t\t" << per_line(t1 - t0) << "\t" << per_line(t3 - t2) << std::endl;
+    std::cout << "kv/logfmt\t" << per_line(t2 - t1) << "\t" << per_line(t4 - t3) << std::endl;
+    std::cout << out;
+    std::cout << "checksum " << sink << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    return 0;
+}
+
+// 被等级过滤掉的日志调用的开销，应当只有一次原子读和一次分支
+int filtered_benchmark(size_t iterations)
+{
+    log_system_module_init();
+    auto logger = mylog::GetLogger("performance_logger");
+    logger->SetLevel(mylog::LogLevel::value::WARN);
+
+    size_t alloc_start = g_alloc_count.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        logger->Info("Performance test log message #%zu from thread %llu", i, 0ULL);
+    }
+    auto end = std::chrono::steady_clock::now();
+    size_t alloc_end = g_alloc_count.load();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Filtered call benchmark (" << iterations << " Info calls, level WARN)" << std::endl;
+    std::cout << "Filtered Info: " << ns << " ns/call, "
+              << double(alloc_end - alloc_start) / iterations << " allocations/call" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    return 0;
+}
+
+// 被调用点采样或限流拦下的日志调用的开销，和真正输出的 Info 对比
+int sampled_benchmark(size_t iterations)
+{
+    log_system_module_init();
+    mylog::AsyncLogger* logger = MYLOG_LOGGER("performance_logger");
+    logger->SetSiteRateLimit(100, 10);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        INFO_EVERY_N(logger, 1000, "Performance test log message #%zu from thread %llu", i, 0ULL);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        INFO_EVERY_MS(logger, 1000, "Performance test log message #%zu from thread %llu", i, 0ULL);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        INFO_LIMITED(logger, "Performance test log message #%zu from thread %llu", i, 0ULL);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    size_t logged = iterations / 100;
+    for (size_t i = 0; i < logged; ++i) {
+        logger->Info("Performance test log message #%zu from thread %llu", i, 0ULL);
+    }
+    auto t4 = std::chrono::steady_clock::now();
+
+    auto per_call = [](std::chrono::steady_clock::duration d, size_t n) {
+        return std::chrono::duration<double, std::nano>(d).count() / n;
+    };
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Sampled call benchmark (" << iterations << " calls per mode)" << std::endl;
+    std::cout << "INFO_EVERY_N(1000): " << per_call(t1 - t0, iterations) << " ns/call" << std::endl;
+    std::cout << "INFO_EVERY_MS(1000): " << per_call(t2 - t1, iterations) << " ns/call" << std::endl;
+    std::cout << "INFO_LIMITED(100/s): " << per_call(t3 - t2, iterations) << " ns/call" << std::endl;
+    std::cout << "Info (logged): " << per_call(t4 - t3, logged) << " ns/call" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    return 0;
+}
+
+// 热点调用点取日志器的开销：按名字查找并复制 shared_ptr，对比调用点缓存的句柄
+int lookup_benchmark(size_t iterations)
+{
+    log_system_module_init();
+    uintptr_t sink = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += reinterpret_cast<uintptr_t>(mylog::GetLogger("performance_logger").get());
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += reinterpret_cast<uintptr_t>(MYLOG_LOGGER("performance_logger"));
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    auto per_call = [iterations](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::nano>(d).count() / iterations;
+    };
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Logger lookup benchmark (" << iterations << " lookups)" << std::endl;
+    std::cout << "GetLogger(name): " << per_call(t1 - t0) << " ns/lookup" << std::endl;
+    std::cout << "MYLOG_LOGGER(name): " << per_call(t2 - t1) << " ns/lookup" << std::endl;
+    std::cout << "checksum " << sink << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    return 0;
+}
+
+// selfcheck 模式：几个容易改坏的编解码细节，任何一项不对就返回非0
+static int g_check_failures = 0;
+#define SELF_CHECK(cond)                                                                      \
+    do {                                                                                      \
+        if (!(cond)) {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            ++g_check_failures;                                                               \
+        }                                                                                     \
+    } while (0)
+
+// 备份批次帧：压缩和不压缩两种负载都能原样解回，负载被改动时 CRC 校验拒绝
+void check_backup_protocol()
+{
+    namespace bp = mylog::BackupProtocol;
+    std::vector<std::string> small = {"first line", "", "third line"};
+    std::vector<std::string> large(64, std::string(100, 'x'));
+    for (const auto* records : {&small, &large}) {
+        std::string raw, frame;
+        for (const std::string& r : *records) bp::AppendRecord(r, &raw);
+        bp::EncodeBatch(42, static_cast<uint32_t>(records->size()), raw, &frame);
+
+        bp::FrameHead head;
+        SELF_CHECK(frame.size() >= bp::kHeadSize && bp::DecodeHead(frame.data(), &head));
+        SELF_CHECK(head.type == bp::kBatch && head.seq == 42 && head.count == records->size());
+        SELF_CHECK(head.payload_len == frame.size() - bp::kHeadSize);
+        SELF_CHECK(((head.flags & bp::kZlib) != 0) == (records == &large));
+
+        std::string decoded;
+        std::vector<std::string> out;
+        SELF_CHECK(bp::DecodeBatch(head, frame.data() + bp::kHeadSize, &decoded));
+        SELF_CHECK(bp::ForEachRecord(head, decoded, [&out](const char* data, uint32_t len) {
+            out.emplace_back(data, len);
+        }));
+        SELF_CHECK(out == *records);
+
+        std::string corrupt = frame;
+        corrupt[bp::kHeadSize + head.payload_len / 2] ^= 0x20;
+        SELF_CHECK(!bp::DecodeBatch(head, corrupt.data() + bp::kHeadSize, &decoded));
+    }
+
+    std::string ack;
+    bp::EncodeAck(7, &ack);
+    bp::FrameHead head;
+    SELF_CHECK(ack.size() == bp::kHeadSize && bp::DecodeHead(ack.data(), &head));
+    SELF_CHECK(head.type == bp::kAck && head.seq == 7 && head.payload_len == 0);
+    ack[0] ^= 1;
+    SELF_CHECK(!bp::DecodeHead(ack.data(), &head));
+}
+
+// 备份暂存：最后一个分段末尾写了一半的记录在重新打开时被截掉，之后照常追加和确认
+void check_backup_spool()
+{
+    const std::string dir = "./perftest_log/selfcheck_spool/";
+    const std::string path = dir + "spool";
+    std::filesystem::remove_all(dir);
+    std::vector<std::string> written = {"alpha", "beta", "", "delta"};
+    {
+        mylog::BackupSpool spool(path, 1 << 20);
+        for (const std::string& r : written) SELF_CHECK(spool.Append(r));
+    }
+    // 模拟写到一半时崩溃：记录头说有 100 字节，实际只写了 3 字节
+    FILE* fp = fopen((path + ".00000001").c_str(), "ab");
+    SELF_CHECK(fp != NULL);
+    if (fp == NULL) return;
+    uint32_t len = htobe32(100);
+    fwrite(&len, 4, 1, fp);
+    fwrite("abc", 3, 1, fp);
+    fclose(fp);
+
+    std::vector<std::string> records;
+    mylog::BackupSpool::Position end;
+    {
+        mylog::BackupSpool spool(path, 1 << 20);
+        spool.Read(1 << 20, &records, &end);
+        SELF_CHECK(records == written);
+        SELF_CHECK(spool.Append("after"));
+        records.clear();
+        spool.Read(1 << 20, &records, &end);
+        SELF_CHECK(records == std::vector<std::string>{"after"});
+        spool.Commit(end);
+    }
+    {
+        mylog::BackupSpool spool(path, 1 << 20);
+        SELF_CHECK(!spool.HasUnread());
+    }
+    // cursor 比分段还长(截断后来不及写 cursor)时从分段末尾接着读，新记录不会被跳过
+    fp = fopen((path + ".cursor").c_str(), "w");
+    SELF_CHECK(fp != NULL);
+    if (fp == NULL) return;
+    fprintf(fp, "1 999999\n");
+    fclose(fp);
+    {
+        mylog::BackupSpool spool(path, 1 << 20);
+        SELF_CHECK(spool.Append("kept"));
+        records.clear();
+        spool.Read(1 << 20, &records, &end);
+        SELF_CHECK(records == std::vector<std::string>{"kept"});
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// 结构化字段的转义：logfmt 里含空白、引号、等号、控制字符的键和值加引号转义，JSON 只转义引号、反斜杠和控制字符
+void check_structured_escaping()
+{
+    std::string text = "a \"q\" b=c\n\t\x01\\";
+    std::string del = "\x7f";
+    std::string empty;
+    int n = 5;
+    mylog::LogMessage msg;
+    msg.Init(mylog::LogLevel::value::INFO, "f.cpp", 7, "performance_logger");
+    msg.structured_ = true;
+    size_t size = mylog::StructuredFields::EncodedSize("evt", mylog::kv("msg", text), mylog::kv("plain", "ok"),
+                                                       mylog::kv("empty", empty), mylog::kv("del", del),
+                                                       mylog::kv("k=v", n));
+    mylog::StructuredFields::Encode(msg.PayloadBuffer(size), "evt", mylog::kv("msg", text), mylog::kv("plain", "ok"),
+                                    mylog::kv("empty", empty), mylog::kv("del", del), mylog::kv("k=v", n));
+    msg.SetPayloadSize(size);
+
+    std::string logfmt;
+    mylog::StructuredFields::RenderLogfmt(msg.Payload(), &logfmt);
+    SELF_CHECK(logfmt == "evt msg=\"a \\\"q\\\" b=c\\n\\t\\u0001\\\\\" plain=ok empty=\"\" del=\"\\u007f\" \"k=v\"=5");
+
+    std::string json;
+    mylog::StructuredFields::RenderJson(msg, &json);
+    const std::string fields = ",\"event\":\"evt\",\"msg\":\"a \\\"q\\\" b=c\\n\\t\\u0001\\\\\",\"plain\":\"ok\","
+                               "\"empty\":\"\",\"del\":\"\x7f\",\"k=v\":5}\n";
+    SELF_CHECK(json.size() > fields.size() && json.compare(json.size() - fields.size(), fields.size(), fields) == 0);
+    SELF_CHECK(json.find(",\"file\":\"f.cpp\",\"line\":7") != std::string::npos);
+}
+
+// 请求路由：没有匹配的路径是 404，路径匹配但方法不对是 405 并带回可用方法；
+// 请求路径先做 %解码，不完整或非法的 %编码要被拒绝(400)而不是触发 assert
+void check_router()
+{
+    storage::Router router;
+    storage::RouteHandler noop = [](struct evhttp_request*, storage::RouteContext&) {};
+    SELF_CHECK(router.Add(EVHTTP_REQ_GET | EVHTTP_REQ_HEAD, "/download/*name", noop));
+    SELF_CHECK(router.Add(EVHTTP_REQ_PUT, "/session/:id/part/:no", noop));
+    SELF_CHECK(router.Add(EVHTTP_REQ_POST, "/upload", noop));
+    SELF_CHECK(!router.Add(EVHTTP_REQ_POST, "/upload", noop));
+
+    storage::RouteHandler handler;
+    storage::RouteParams params;
+    int allowed = 0;
+    using Match = storage::Router::MatchResult;
+    SELF_CHECK(router.Match(EVHTTP_REQ_GET, "/download/a/b.txt", &handler, &params, &allowed) == Match::FOUND);
+    SELF_CHECK(params.Get("name") == "a/b.txt");
+    SELF_CHECK(router.Match(EVHTTP_REQ_PUT, "/session/abc/part/3", &handler, &params, &allowed) == Match::FOUND);
+    SELF_CHECK(params.Get("id") == "abc" && params.Get("no") == "3");
+    SELF_CHECK(router.Match(EVHTTP_REQ_GET, "/nothing", &handler, &params, &allowed) == Match::NOT_FOUND);
+    SELF_CHECK(router.Match(EVHTTP_REQ_GET, "/download/", &handler, &params, &allowed) == Match::NOT_FOUND);
+    SELF_CHECK(router.Match(EVHTTP_REQ_PUT, "/session//part/3", &handler, &params, &allowed) == Match::NOT_FOUND);
+    SELF_CHECK(router.Match(EVHTTP_REQ_DELETE, "/upload", &handler, &params, &allowed) == Match::METHOD_NOT_ALLOWED);
+    SELF_CHECK(allowed == EVHTTP_REQ_POST);
+    SELF_CHECK(router.Match(EVHTTP_REQ_POST, "/download/x", &handler, &params, &allowed) ==
+               Match::METHOD_NOT_ALLOWED);
+    SELF_CHECK(storage::Router::MethodNames(allowed) == "GET, HEAD");
+
+    std::string decoded;
+    SELF_CHECK(storage::UrlDecode("/download/a%20b%2Fc", &decoded) && decoded == "/download/a b/c");
+    for (const char* bad : {"/download/%", "/download/%2", "/download/%zz", "/download/%2g"}) {
+        SELF_CHECK(!storage::UrlDecode(bad, &decoded));
+    }
+}
+
+int selfcheck()
+{
+    check_backup_protocol();
+    check_backup_spool();
+    check_structured_escaping();
+    check_router();
+    std::cout << (g_check_failures == 0 ? "selfcheck passed" : "selfcheck FAILED") << std::endl;
+    return g_check_failures == 0 ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <num_threads> <logs_per_thread>" << std::endl;
+    if (argc >= 2 && std::string(argv[1]) == "selfcheck") {
+        return selfcheck();
+    }
+    if (argc >= 2 && std::string(argv[1]) == "format") {
+        return format_benchmark(argc >= 3 ? std::stoul(argv[2]) : 1000000);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "payload") {
+        return payload_benchmark(argc >= 3 ? std::stoul(argv[2]) : 1000000);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "filtered") {
+        return filtered_benchmark(argc >= 3 ? std::stoul(argv[2]) : 10000000);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "structured") {
+        return structured_benchmark(argc >= 3 ? std::stoul(argv[2]) : 1000000);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "sampled") {
+        return sampled_benchmark(argc >= 3 ? std::stoul(argv[2]) : 10000000);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "lookup") {
+        return lookup_benchmark(argc >= 3 ? std::stoul(argv[2]) : 10000000);
+    }
+    const std::string mode = argc == 4 ? argv[3] : "";
+    if (argc != 3 && !(argc == 4 && (mode == "binary" || mode == "mmap"))) {
+        std::cerr << "Usage: " << argv[0] << " <num_threads> <logs_per_thread> [binary|mmap]" << std::endl;
+        std::cerr << "       " << argv[0] << " format [iterations]" << std::endl;
+        std::cerr << "       " << argv[0] << " payload [iterations]" << std::endl;
+        std::cerr << "       " << argv[0] << " filtered [iterations]" << std::endl;
+        std::cerr << "       " << argv[0] << " lookup [iterations]" << std::endl;
+        std::cerr << "       " << argv[0] << " structured [iterations]" << std::endl;
+        std::cerr << "       " << argv[0] << " sampled [iterations]" << std::endl;
+        std::cerr << "       " << argv[0] << " selfcheck" << std::endl;
         return 1;
     }
+    const bool binary = mode == "binary";
+    const bool mmap = mode == "mmap";
 
     const size_t num_threads = std::stoul(argv[1]);
     const size_t logs_per_thread = std::stoul(argv[2]);
     const size_t total_logs_expected = num_threads * logs_per_thread;
 
     log_system_module_init();
-    auto logger = mylog::GetLogger("performance_logger");
+    auto logger = mylog::GetLogger(binary ? "performance_logger_bin"
+                                   : mmap ? "performance_logger_mmap" : "performance_logger");
     if (!logger) {
         std::cerr << "Failed to get logger!" << std::endl;
         return 1;
     }
 
     std::cout << "Starting performance test with " << num_threads << " threads, "
-              << logs_per_thread << " logs per thread." << std::endl;
+              << logs_per_thread << " logs per thread"
+              << (binary ? " (binary mode)." : mmap ? " (mmap sink)." : ".") << std::endl;
 
     std::vector<std::thread> threads;
     std::atomic<size_t> total_logs_written(0);
 
+    size_t alloc_before = g_alloc_count.load();
     auto start_time = std::chrono::high_resolution_clock::now();
     
     for (size_t i = 0; i < num_threads; ++i) {
-        threads.emplace_back(worker_thread, logger, logs_per_thread, std::ref(total_logs_written));
+        threads.emplace_back(worker_thread, logger, logs_per_thread, std::ref(total_logs_written), binary);
     }
 
     for (auto& t : threads) {
@@ -70,9 +633,11 @@ int main(int argc, char* argv[]) {
     }
     
     auto api_end_time = std::chrono::high_resolution_clock::now();
+    size_t alloc_during_api = g_alloc_count.load() - alloc_before;
 
     std::cout << "All log APIs returned. Waiting for logs to be flushed to disk..." << std::endl;
     // 释放logger，析构和shuapan
+    std::string sink_report = logger->SinkReport();
     logger.reset();
 
     auto flush_end_time = std::chrono::high_resolution_clock::now();
@@ -87,6 +652,16 @@ int main(int argc, char* argv[]) {
     std::cout << "Time for API calls: " << api_elapsed.count() << " seconds" << std::endl;
     std::cout << "Total time (including flush): " << total_elapsed.count() << " seconds" << std::endl;
     std::cout << "Throughput (API rate): " << static_cast<long long>(throughput) << " logs/second" << std::endl;
+    // 每个生产者线程的速率，线程数增加时这个值不应明显下降
+    std::cout << "Per-thread API rate: " << static_cast<long long>(throughput / num_threads) << " logs/second" << std::endl;
+    // 统计的是API阶段全进程(包括后台线程)的分配次数
+    std::cout << "Allocations per log line: " << double(alloc_during_api) / total_logs_expected << std::endl;
+    std::cout << "Sink backlog when the APIs returned:" << std::endl << sink_report;
+    if (mmap) {
+        std::cout << g_mmap_flush->SyncReport() << std::endl;
+    } else if (!binary) {
+        std::cout << g_text_flush->SyncReport() << std::endl;
+    }
     std::cout << "----------------------------------------" << std::endl;
 
     return 0;